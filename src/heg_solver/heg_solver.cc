@@ -9,22 +9,28 @@
 #include "k_points_util.h"
 #include "omp.h"
 
-void HEGSolver::solve() {
+template <size_t N>
+void HEGSolver<N>::load_config() {
   n_up = Config::get<size_t>("n_up");
   n_dn = Config::get<size_t>("n_dn");
   rcut_vars = Config::get_array<double>("rcut_vars");
   eps_vars = Config::get_array<double>("eps_vars");
+  sparse_hamiltonian = Config::get<bool>("sparse_hamiltonian", false);
+}
 
+template <size_t N>
+void HEGSolver<N>::solve_variation() {
+  load_config();
   Time::start("variation");
   for (size_t i = 0; i < rcut_vars.size(); i++) {
     if (i > 0 && rcut_vars[i] == rcut_vars[i - 1]) continue;
     const double rcut_var = rcut_vars[i];
-    wf.clear();
+    clear_wf();
     std::string rcut_var_event = str(boost::format("rcut_var: %#.4g") % rcut_var);
     Time::start(rcut_var_event);
 
     Time::start("setup");
-    setup(rcut_var);
+    setup(rcut_var, *std::min_element(eps_vars.begin(), eps_vars.end()));
     Time::end();
 
     for (size_t j = 0; j < eps_vars.size(); j++) {
@@ -43,9 +49,31 @@ void HEGSolver::solve() {
   }
   Time::end();
 
+  // The perturbation may run on a solver of another det width, which needs the memory.
+  release();
+}
+
+template <size_t N>
+void HEGSolver<N>::release() {
+  clear_wf();
+  std::vector<std::array<int8_t, 3>>().swap(k_points);
+  std::vector<double>().swap(one_body_energies);
+  std::vector<double>().swap(coulomb_table);
+  std::vector<Orbital>().swap(k_grid);
+  std::vector<std::array<int8_t, 3>>().swap(k_diffs);
+  std::vector<size_t>().swap(same_spin_hci_queue_offsets);
+  same_spin_hci_queue_diffs.clear();
+  same_spin_hci_queue_values.clear();
+  opposite_spin_hci_queue = HCIQueue();
+  std::vector<LazyHCIQueueCache>().swap(lazy_hci_queue_caches);
+}
+
+template <size_t N>
+void HEGSolver<N>::solve_perturbation() {
   const bool variation_only = Config::get<bool>("variation_only", false);
   if (variation_only) return;
 
+  load_config();
   Time::start("perturbation");
   // Start from the largest PT so that it fails earlier upon insufficient memory.
   for (const double rcut_var : rcut_vars | boost::adaptors::reversed) {
@@ -57,12 +85,12 @@ void HEGSolver::solve() {
     if (Parallel::is_master()) {
       printf("rcut_pt: %#.4g (%#.4g * %#.4g)\n", rcut_pt, rcut_var, rcut_pt_ratio);
     }
-    setup(rcut_pt);
+    const double eps_pt_ratio = Config::get<double>("eps_pt_ratio", 0.01);
+    setup(rcut_pt, *std::min_element(eps_vars.begin(), eps_vars.end()) * eps_pt_ratio);
     Time::end();
     for (const double eps_var : eps_vars | boost::adaptors::reversed) {
       std::string eps_var_event = str(boost::format("eps_var: %#.4g") % eps_var);
       Time::start(eps_var_event);
-      const double eps_pt_ratio = Config::get<double>("eps_pt_ratio", 0.01);
       const double eps_pt = eps_var * eps_pt_ratio;
         if (Parallel::is_master()) {
           printf("rcut_pt: %#.4g (%zu orbs)\n", rcut_pt, k_points.size() * 2);          
@@ -78,75 +106,234 @@ void HEGSolver::solve() {
   Time::end();
 }
 
-void HEGSolver::setup(const double rcut) {
-  const double r_s = Config::get<double>("r_s");
-  const double density = 3.0 / (4.0 * M_PI * pow(r_s, 3));
-  const double cell_length = pow((n_up + n_dn) / density, 1.0 / 3);
-  k_unit = 2 * M_PI / cell_length;
-  H_unit = 1.0 / (M_PI * cell_length);
-  k_points = KPointsUtil::generate_k_points(rcut);
-  for (size_t i = 0; i < k_points.size(); i++) k_lut[k_points[i]] = i;
+template <size_t N>
+void HEGSolver<N>::setup(const double rcut, const double hci_queue_eps) {
+  setup_basis(rcut, Config::get<double>("r_s"));
   if (Parallel::is_master()) {
     printf("number of orbitals: %d\n", static_cast<int>(k_points.size() * 2));
   }
   Time::checkpoint("k points generated");
 
+  // Items below the smallest eps of the stage are never reached.
+  this->hci_queue_eps = hci_queue_eps;
+  lazy_hci_queue = Config::get<bool>("lazy_hci_queue", false);
+  lazy_hci_queue_max_items = Config::get<double>("hci_queue_cache_mb", 1000.0) * 1e6 /
+                             (sizeof(std::array<int8_t, 3>) + sizeof(float));
   generate_hci_queue(rcut);
   Time::checkpoint("hci queue generated");
 }
 
-void HEGSolver::generate_hci_queue(const double rcut) {
-  same_spin_hci_queue.clear();
-  opposite_spin_hci_queue.clear();
-  max_abs_H = 0.0;
+template <size_t N>
+void HEGSolver<N>::setup_lazy(
+    const size_t n_up,
+    const size_t n_dn,
+    const double r_s,
+    const double rcut,
+    const double eps,
+    const bool sparse_hamiltonian) {
+  this->n_up = n_up;
+  this->n_dn = n_dn;
+  this->sparse_hamiltonian = sparse_hamiltonian;
+  setup_basis(rcut, r_s);
+  hci_queue_eps = eps;
+  lazy_hci_queue = true;
+  lazy_hci_queue_max_items = std::numeric_limits<size_t>::max();
+  generate_hci_queue(rcut);
+}
+
+template <size_t N>
+void HEGSolver<N>::setup_basis(const double rcut, const double r_s) {
+  const double density = 3.0 / (4.0 * M_PI * pow(r_s, 3));
+  const double cell_length = pow((n_up + n_dn) / density, 1.0 / 3);
+  k_unit = 2 * M_PI / cell_length;
+  H_unit = 1.0 / (M_PI * cell_length);
+  k_points = KPointsUtil::generate_k_points(rcut);
+  if (k_points.size() > SpinDet<N>::N_ORBS_MAX) {
+    throw std::invalid_argument("Too many orbitals for the spin det width.");
+  }
+  generate_k_grid();
+  generate_matrix_element_tables();
+}
+
+template <size_t N>
+constexpr Orbital HEGSolver<N>::K_GRID_NONE;
+
+template <size_t N>
+void HEGSolver<N>::generate_k_grid() {
+  // Candidate momenta are k_p + k_q - k_r, so the grid spans three times the k points.
+  int n_max = 0;
+  for (const auto& k : k_points) {
+    for (const auto k_i : k) n_max = std::max(n_max, std::abs(static_cast<int>(k_i)));
+  }
+  k_grid_n_max = n_max * 3;
+  k_grid_width = 2 * k_grid_n_max + 1;
+  k_grid.assign(k_grid_width * k_grid_width * k_grid_width, K_GRID_NONE);
+  for (size_t i = 0; i < k_points.size(); i++) k_grid[get_k_index(k_points[i])] = i;
+}
+
+template <size_t N>
+void HEGSolver<N>::generate_matrix_element_tables() {
+  const size_t n_orbs = k_points.size();
+  one_body_energies.resize(n_orbs);
+  int max_squared_norm = 0;
+  for (size_t p = 0; p < n_orbs; p++) {
+    one_body_energies[p] = squared_norm(k_points[p] * k_unit) * 0.5;
+    max_squared_norm = std::max(max_squared_norm, squared_norm(cast<int>(k_points[p])));
+  }
+
+  // |k_p - k_q|^2 is an integer no larger than (2 |k|_max)^2, so O(rcut^2) entries.
+  coulomb_table.assign(max_squared_norm * 4 + 1, 0.0);
+  for (size_t i = 1; i < coulomb_table.size(); i++) coulomb_table[i] = H_unit / i;
+}
+
+template <size_t N>
+void HEGSolver<N>::generate_hci_queue(const double rcut) {
+  hci_queue_rcut = rcut;
+  k_diffs = KPointsUtil::get_k_diffs(k_points);
 
-  // Common dependencies.
-  const auto& k_diffs = KPointsUtil::get_k_diffs(k_points);
+  // Opposite spin. Its largest element also bounds the same-spin ones, which are differences
+  // of two of them.
+  std::vector<HCIQueueItem> items;
+  for (const auto& diff_pr : k_diffs) {
+    const double H = H_unit / squared_norm(cast<int>(diff_pr));
+    if (H < hci_queue_eps) continue;
+    items.push_back(std::make_pair(diff_pr, H));
+  }
+  fill_hci_queue(items, opposite_spin_hci_queue);
+  max_abs_H = items.empty() ? 0.0 : items.front().second;
+
+  // Same spin, only for the canonical diff_pq since the queue of g(diff_pq) is g(queue) for
+  // any cubic symmetry operation g.
+  same_spin_hci_queue_offsets.assign(k_grid.size() + 1, 0);
+  lazy_hci_queue_caches.clear();
+  if (lazy_hci_queue) {
+    lazy_hci_queue_caches.resize(omp_get_max_threads());
+    for (auto& cache : lazy_hci_queue_caches) cache.n_items = 0;
+    return;
+  }
 
-  // Same spin.
+  // Each proc builds every n_procs-th queue with its threads.
+  std::vector<std::array<int8_t, 3>> canonical_diffs;
   for (const auto& diff_pq : k_diffs) {
-    for (const auto& diff_pr : k_diffs) {
-      const auto& diff_sr = diff_pr + diff_pr - diff_pq;  // Momentum conservation.
-      if (diff_sr == 0 || norm(diff_sr) > rcut * 2) continue;
-      const auto& diff_ps = diff_pr - diff_sr;
-      if (diff_ps == 0) continue;
-      if (squared_norm(diff_pr) == squared_norm(diff_ps)) continue;
-      const double abs_H = fabs(1.0 / squared_norm(diff_pr) - 1.0 / squared_norm(diff_ps));
-      if (abs_H < DBL_EPSILON) continue;
-      const auto& item = std::make_pair(diff_pr, abs_H * H_unit);
-      same_spin_hci_queue[diff_pq].push_back(item);
-    }
+    if (KPointsUtil::is_canonical(diff_pq)) canonical_diffs.push_back(diff_pq);
   }
-  for (auto& kv : same_spin_hci_queue) {
-    auto& items = kv.second;
-    std::stable_sort(
-        items.begin(),
-        items.end(),
-        [](const std::pair<std::array<int8_t, 3>, double>& a,
-           const std::pair<std::array<int8_t, 3>, double>& b) -> bool {
-          return a.second > b.second;
-        });
-    max_abs_H = std::max(max_abs_H, items.front().second);
+  const size_t n_canonical_diffs = canonical_diffs.size();
+  const size_t proc_id = Parallel::get_id();
+  const size_t n_procs = Parallel::get_n();
+  std::vector<HCIQueue> local_queues((n_canonical_diffs + n_procs - 1 - proc_id) / n_procs);
+#pragma omp parallel for schedule(dynamic, 1)
+  for (size_t i = proc_id; i < n_canonical_diffs; i += n_procs) {
+    generate_same_spin_hci_queue(canonical_diffs[i], local_queues[i / n_procs]);
   }
 
-  // Opposite spin.
-  for (const auto& diff_pr : k_diffs) {
-    const double abs_H = 1.0 / sum(square(diff_pr));
-    if (abs_H < DBL_EPSILON) continue;
-    const auto& item = std::make_pair(diff_pr, abs_H * H_unit);
-    opposite_spin_hci_queue.push_back(item);
+  // Assemble the CSR layout in packed k order from the sizes of all the queues.
+  std::vector<size_t> local_sizes;
+  for (const auto& queue : local_queues) local_sizes.push_back(queue.values.size());
+  std::vector<std::vector<size_t>> sizes;
+  Parallel::all_gather(local_sizes, sizes);
+  for (size_t i = 0; i < n_canonical_diffs; i++) {
+    same_spin_hci_queue_offsets[get_k_index(canonical_diffs[i]) + 1] =
+        sizes[i % n_procs][i / n_procs];
+  }
+  for (size_t i = 0; i < k_grid.size(); i++) {
+    same_spin_hci_queue_offsets[i + 1] += same_spin_hci_queue_offsets[i];
+  }
+
+  // Each proc writes its queues into the copy of its node. The copies of the nodes hold
+  // disjoint items on zeros, so summing them completes every copy.
+  const size_t n_items = same_spin_hci_queue_offsets.back();
+  same_spin_hci_queue_diffs.allocate(n_items * 3);
+  same_spin_hci_queue_values.allocate(n_items);
+  for (size_t i = proc_id; i < n_canonical_diffs; i += n_procs) {
+    HCIQueue& queue = local_queues[i / n_procs];
+    const size_t offset = same_spin_hci_queue_offsets[get_k_index(canonical_diffs[i])];
+    for (size_t k = 0; k < queue.values.size(); k++) {
+      std::copy(
+          queue.diffs[k].begin(),
+          queue.diffs[k].end(),
+          same_spin_hci_queue_diffs.data() + (offset + k) * 3);
+      same_spin_hci_queue_values.data()[offset + k] = queue.values[k];
+    }
+    queue = HCIQueue();
   }
+  same_spin_hci_queue_diffs.reduce_to_sum_across_nodes();
+  same_spin_hci_queue_values.reduce_to_sum_across_nodes();
+}
+
+template <size_t N>
+void HEGSolver<N>::fill_hci_queue(std::vector<HCIQueueItem>& items, HCIQueue& queue) {
   std::stable_sort(
-      opposite_spin_hci_queue.begin(),
-      opposite_spin_hci_queue.end(),
-      [](const std::pair<std::array<int8_t, 3>, double>& a,
-         const std::pair<std::array<int8_t, 3>, double>& b) -> bool {
+      items.begin(), items.end(), [](const HCIQueueItem& a, const HCIQueueItem& b) -> bool {
         return a.second > b.second;
       });
-  max_abs_H = std::max(max_abs_H, opposite_spin_hci_queue.front().second);
+  queue.diffs.resize(items.size());
+  queue.values.resize(items.size());
+  for (size_t i = 0; i < items.size(); i++) {
+    queue.diffs[i] = items[i].first;
+    queue.values[i] = items[i].second;
+  }
+}
+
+template <size_t N>
+void HEGSolver<N>::generate_same_spin_hci_queue(
+    const std::array<int8_t, 3>& diff_pq, HCIQueue& queue) const {
+  std::vector<HCIQueueItem> items;
+  // Squared norms in int, which int8 overflows beyond rcut of about 5.6.
+  const auto& diff_pq_int = cast<int>(diff_pq);
+  const double max_squared_norm_sr = hci_queue_rcut * hci_queue_rcut * 4;
+  for (const auto& diff_pr : k_diffs) {
+    const auto& diff_pr_int = cast<int>(diff_pr);
+    const auto& diff_sr = diff_pr_int + diff_pr_int - diff_pq_int;  // Momentum conservation.
+    if (diff_sr == 0 || squared_norm(diff_sr) > max_squared_norm_sr) continue;
+    const auto& diff_ps = diff_pr_int - diff_sr;
+    if (diff_ps == 0) continue;
+    const int squared_norm_pr = squared_norm(diff_pr_int);
+    const int squared_norm_ps = squared_norm(diff_ps);
+    if (squared_norm_pr == squared_norm_ps) continue;
+    const double abs_H = fabs(1.0 / squared_norm_pr - 1.0 / squared_norm_ps);
+    if (abs_H < DBL_EPSILON || abs_H * H_unit < hci_queue_eps) continue;
+    items.push_back(std::make_pair(diff_pr, abs_H * H_unit));
+  }
+  fill_hci_queue(items, queue);
 }
 
-double HEGSolver::hamiltonian(const Det& det_pq, const Det& det_rs) const {
+template <size_t N>
+typename HEGSolver<N>::HCIQueueView HEGSolver<N>::get_same_spin_hci_queue(
+    const std::array<int8_t, 3>& diff_pq) const {
+  const size_t queue_id = get_k_index(diff_pq);
+  if (!lazy_hci_queue) {
+    const size_t offset = same_spin_hci_queue_offsets[queue_id];
+    const size_t n_items = same_spin_hci_queue_offsets[queue_id + 1] - offset;
+    static_assert(sizeof(std::array<int8_t, 3>) == 3, "Packed diffs must be 3 bytes.");
+    const auto diffs =
+        reinterpret_cast<const std::array<int8_t, 3>*>(same_spin_hci_queue_diffs.data());
+    return HCIQueueView{
+        Span<std::array<int8_t, 3>>(diffs + offset, n_items),
+        Span<float>(same_spin_hci_queue_values.data() + offset, n_items)};
+  }
+
+  // The threads split the items evenly.
+  auto& cache = lazy_hci_queue_caches[omp_get_thread_num()];
+  const size_t max_items = lazy_hci_queue_max_items / lazy_hci_queue_caches.size();
+  const auto& inserted = cache.queues.insert(std::make_pair(queue_id, HCIQueue()));
+  auto& queue = inserted.first->second;
+  if (inserted.second) {
+    // Evict the oldest queues until the new one fits.
+    generate_same_spin_hci_queue(diff_pq, queue);
+    while (!cache.order.empty() && cache.n_items + queue.values.size() > max_items) {
+      const size_t evicted_id = cache.order.front();
+      cache.n_items -= cache.queues[evicted_id].values.size();
+      cache.queues.erase(evicted_id);
+      cache.order.pop_front();
+    }
+    cache.order.push_back(queue_id);
+    cache.n_items += queue.values.size();
+  }
+  return HCIQueueView{Span<std::array<int8_t, 3>>(queue.diffs), Span<float>(queue.values)};
+}
+
+template <size_t N>
+double HEGSolver<N>::hamiltonian(const Det<N>& det_pq, const Det<N>& det_rs) const {
   double H = 0.0;
 
   if (det_pq == det_rs) {
@@ -154,101 +341,100 @@ double HEGSolver::hamiltonian(const Det& det_pq, const Det& det_rs) const {
     const auto& occ_pq_dn = det_pq.dn.get_elec_orbs();
 
     // One electron operator.
-    for (const auto p : occ_pq_up) H += squared_norm(k_points[p] * k_unit) * 0.5;
-    for (const auto p : occ_pq_dn) H += squared_norm(k_points[p] * k_unit) * 0.5;
+    for (const auto p : occ_pq_up) H += one_body_energies[p];
+    for (const auto p : occ_pq_dn) H += one_body_energies[p];
 
     // Two electrons operator.
     for (size_t i = 0; i < n_up; i++) {
       const auto p = occ_pq_up[i];
       for (size_t j = i + 1; j < n_up; j++) {
         const auto q = occ_pq_up[j];
-        H -= H_unit / squared_norm(k_points[p] - k_points[q]);
+        H -= get_coulomb(p, q);
       }
     }
     for (size_t i = 0; i < n_dn; i++) {
       const auto p = occ_pq_dn[i];
       for (size_t j = i + 1; j < n_dn; j++) {
         const auto q = occ_pq_dn[j];
-        H -= H_unit / squared_norm(k_points[p] - k_points[q]);
+        H -= get_coulomb(p, q);
       }
     }
   } else {
     // Off-diagonal elements.
-    Det det_eor;
-    det_eor.from_eor(det_pq, det_rs);
-    const size_t n_eor_up = det_eor.up.get_n_elecs();
-    const size_t n_eor_dn = det_eor.dn.get_n_elecs();
+    const size_t n_eor_up = det_pq.up.get_n_diffs(det_rs.up);
+    const size_t n_eor_dn = det_pq.dn.get_n_diffs(det_rs.dn);
     if (n_eor_up + n_eor_dn != 4) return 0.0;
-    const auto& eor_up_set_bits = det_eor.up.get_elec_orbs();
-    const auto& eor_dn_set_bits = det_eor.dn.get_elec_orbs();
-    bool k_p_set = false, k_r_set = false;
-    uint16_t orb_p = 0, orb_r = 0, orb_s = 0;
+    Det<N> det_eor;
+    det_eor.from_eor(det_pq, det_rs);
+    const Orbital dn_offset = k_points.size();
+    std::array<Orbital, 2> removed, added;
+    size_t n_removed = 0, n_added = 0;
 
-    // Obtain p, q, s.
+    // Obtain p, q -> r, s.
     std::array<int8_t, 3> k_change;
     k_change.fill(0);
-    for (const auto orb_i : eor_up_set_bits) {
+    for (const auto orb_i : det_eor.up.get_elec_orbs()) {
       if (det_pq.up.get_orb(orb_i)) {
         k_change -= k_points[orb_i];
-        if (!k_p_set) {
-          orb_p = orb_i;
-          k_p_set = true;
-        }
+        removed[n_removed++] = orb_i;
       } else {
         k_change += k_points[orb_i];
-        if (!k_r_set) {
-          orb_r = orb_i;
-          k_r_set = true;
-        } else {
-          orb_s = orb_i;
-        }
+        added[n_added++] = orb_i;
       }
     }
-    for (const auto orb_i : eor_dn_set_bits) {
+    for (const auto orb_i : det_eor.dn.get_elec_orbs()) {
       if (det_pq.dn.get_orb(orb_i)) {
         k_change -= k_points[orb_i];
-        if (!k_p_set) {
-          orb_p = orb_i;
-          k_p_set = true;
-        }
+        removed[n_removed++] = orb_i + dn_offset;
       } else {
         k_change += k_points[orb_i];
-        if (!k_r_set) {
-          orb_r = orb_i;
-          k_r_set = true;
-        } else {
-          orb_s = orb_i;
-        }
+        added[n_added++] = orb_i + dn_offset;
       }
     }
 
     // Check for momentum conservation.
     if (k_change != 0) return 0.0;
 
-    H = H_unit / squared_norm(k_points[orb_p] - k_points[orb_r]);
-    if (n_eor_up != 2) H -= H_unit / squared_norm(k_points[orb_p] - k_points[orb_s]);
-
-    const int gamma_exp =
-        get_gamma_exp(det_pq.up, eor_up_set_bits) + get_gamma_exp(det_pq.dn, eor_dn_set_bits) +
-        get_gamma_exp(det_rs.up, eor_up_set_bits) + get_gamma_exp(det_rs.dn, eor_dn_set_bits);
-    if ((gamma_exp & 1) == 1) H = -H;
+    H = hamiltonian_from_excitation(det_pq, removed[0], removed[1], added[0], added[1]);
   }
   return H;
 }
 
-int HEGSolver::get_gamma_exp(const SpinDet& spin_det, const std::vector<uint16_t>& eor) const {
-  int gamma_exp = 0;
-  int ptr = 0;
-  const auto& occ = spin_det.get_elec_orbs();
-  for (const uint16_t orb_id : eor) {
-    if (!spin_det.get_orb(orb_id)) continue;
-    ptr = std::lower_bound(occ.begin() + ptr, occ.end(), orb_id) - occ.begin();
-    gamma_exp += ptr;
+template <size_t N>
+double HEGSolver<N>::hamiltonian_from_excitation(
+    const Det<N>& det, const Orbital p, const Orbital q, const Orbital r, const Orbital s) const {
+  const Orbital dn_offset = k_points.size();
+  const bool p_up = p < dn_offset, q_up = q < dn_offset, r_up = r < dn_offset, s_up = s < dn_offset;
+  const Orbital p_orb = p_up ? p : p - dn_offset, q_orb = q_up ? q : q - dn_offset;
+  const Orbital r_orb = r_up ? r : r - dn_offset, s_orb = s_up ? s : s - dn_offset;
+
+  double H;
+  if (p_up == q_up) {
+    // Direct minus exchange of the given pairing, which the phase below follows.
+    H = get_coulomb(p_orb, r_orb) - get_coulomb(p_orb, s_orb);
+  } else {
+    H = get_coulomb(p_orb, r_orb);
   }
-  return gamma_exp;
+
+  // Fermionic phase of applying p -> r and then q -> s, from the electrons strictly between the
+  // orbitals of each single excitation.
+  const auto& det_p = p_up ? det.up : det.dn;
+  const auto& det_q = q_up ? det.up : det.dn;
+  int gamma_exp = det_p.get_n_elecs_between(p_orb, r_orb) + det_q.get_n_elecs_between(q_orb, s_orb);
+  if (p_up == q_up) {
+    // Double excitation within one spin: q -> s sees p removed and r added.
+    const Orbital qs_min = std::min(q_orb, s_orb), qs_max = std::max(q_orb, s_orb);
+    if (p_orb > qs_min && p_orb < qs_max) gamma_exp--;
+    if (r_orb > qs_min && r_orb < qs_max) gamma_exp++;
+  }
+  if ((gamma_exp & 1) == 1) H = -H;
+
+  return H;
 }
 
-std::list<OrbitalPair> HEGSolver::get_pq_pairs(const Det& det, const Orbital dn_offset) const {
+template <size_t N>
+std::list<OrbitalPair> HEGSolver<N>::get_pq_pairs(
+    const Det<N>& det, const Orbital dn_offset) const {
   const auto& occ_up = det.up.get_elec_orbs();
   const auto& occ_dn = det.dn.get_elec_orbs();
   const size_t n_up = det.up.get_n_elecs();
@@ -275,9 +461,47 @@ std::list<OrbitalPair> HEGSolver::get_pq_pairs(const Det& det, const Orbital dn_
   return pq_pairs;
 }
 
-std::list<Det> HEGSolver::find_connected_dets(const Det& det, const double eps) const {
-  std::list<Det> connected_dets;
-  connected_dets.push_back(det);
+template <size_t N>
+double HEGSolver<N>::get_excited_diagonal(
+    const Det<N>& det, const double diagonal, const Excitation& excitation) const {
+  const Orbital dn_offset = k_points.size();
+  const Orbital p = excitation[0], q = excitation[1], r = excitation[2], s = excitation[3];
+  const bool p_up = p < dn_offset, q_up = q < dn_offset, r_up = r < dn_offset, s_up = s < dn_offset;
+  const Orbital p_orb = p_up ? p : p - dn_offset, q_orb = q_up ? q : q - dn_offset;
+  const Orbital r_orb = r_up ? r : r - dn_offset, s_orb = s_up ? s : s - dn_offset;
+  double H = diagonal;
+
+  // One electron operator.
+  H += one_body_energies[r_orb] + one_body_energies[s_orb];
+  H -= one_body_energies[p_orb] + one_body_energies[q_orb];
+
+  // Two electrons operator between the excited and the unchanged electrons.
+  for (const auto j : det.up.get_elec_orbs()) {
+    if ((p_up && j == p_orb) || (q_up && j == q_orb)) continue;
+    if (p_up) H += get_coulomb(p_orb, j);
+    if (q_up) H += get_coulomb(q_orb, j);
+    if (r_up) H -= get_coulomb(r_orb, j);
+    if (s_up) H -= get_coulomb(s_orb, j);
+  }
+  for (const auto j : det.dn.get_elec_orbs()) {
+    if ((!p_up && j == p_orb) || (!q_up && j == q_orb)) continue;
+    if (!p_up) H += get_coulomb(p_orb, j);
+    if (!q_up) H += get_coulomb(q_orb, j);
+    if (!r_up) H -= get_coulomb(r_orb, j);
+    if (!s_up) H -= get_coulomb(s_orb, j);
+  }
+
+  // Two electrons operator among the excited electrons.
+  if (p_up == q_up) H += get_coulomb(p_orb, q_orb);
+  if (r_up == s_up) H -= get_coulomb(r_orb, s_orb);
+
+  return H;
+}
+
+template <size_t N>
+std::list<std::pair<Det<N>, Excitation>> HEGSolver<N>::find_connected_dets(
+    const Det<N>& det, const double eps) const {
+  std::list<std::pair<Det<N>, Excitation>> connected_dets;
 
   if (max_abs_H < eps) return connected_dets;
 
@@ -298,27 +522,31 @@ std::list<Det> HEGSolver::find_connected_dets(const Det& det, const double eps)
       qq = p + dn_offset;
     }
     bool same_spin = false;
-    std::vector<std::pair<std::array<int8_t, 3>, double>> const* items_ptr;
+    HCIQueueView queue;
+    KSymmetryOp op{{{0, 1, 2}}, {{1, 1, 1}}};
     if (pp < dn_offset && qq < dn_offset) {
       same_spin = true;
       const auto& diff_pq = k_points[qq] - k_points[pp];
-      items_ptr = &(same_spin_hci_queue.find(diff_pq)->second);
+      op = KPointsUtil::get_canonical_op(diff_pq);
+      queue = get_same_spin_hci_queue(op.apply(diff_pq));
     } else {
-      items_ptr = &(opposite_spin_hci_queue);
+      queue = HCIQueueView{Span<std::array<int8_t, 3>>(opposite_spin_hci_queue.diffs),
+                           Span<float>(opposite_spin_hci_queue.values)};
     }
-    const auto& items = *items_ptr;
     Orbital qs_offset = 0;
     if (!same_spin) qs_offset = dn_offset;
 
-    for (const auto& item : items) {
-      if (item.second < eps) break;
-      const auto& diff_pr = item.first;
-      const auto& it_r = k_lut.find(diff_pr + k_points[pp]);
-      if (it_r == k_lut.end()) continue;
-      Orbital r = it_r->second;
-      const auto& it_s = k_lut.find(k_points[pp] + k_points[qq - qs_offset] - k_points[r]);
-      if (it_s == k_lut.end()) continue;
-      Orbital s = it_s->second;
+    // The items not below eps form a prefix of the queue.
+    const size_t n_items =
+        std::partition_point(
+            queue.values.begin(), queue.values.end(), [eps](const float H) { return H >= eps; }) -
+        queue.values.begin();
+    for (size_t k = 0; k < n_items; k++) {
+      const auto& diff_pr = same_spin ? op.apply_inverse(queue.diffs[k]) : queue.diffs[k];
+      Orbital r = k_grid[get_k_index(diff_pr + k_points[pp])];
+      if (r == K_GRID_NONE) continue;
+      Orbital s = k_grid[get_k_index(k_points[pp] + k_points[qq - qs_offset] - k_points[r])];
+      if (s == K_GRID_NONE) continue;
       if (same_spin && s < r) continue;
       s += qs_offset;
       if (p >= dn_offset && q >= dn_offset) {
@@ -332,8 +560,8 @@ std::list<Det> HEGSolver::find_connected_dets(const Det& det, const double eps)
 
       // Test whether pqrs is a valid excitation for det.
       if (det.get_orb(r, dn_offset) || det.get_orb(s, dn_offset)) continue;
-      connected_dets.push_back(det);
-      Det& new_det = connected_dets.back();
+      connected_dets.push_back(std::make_pair(det, Excitation({p, q, r, s})));
+      Det<N>& new_det = connected_dets.back().first;
       new_det.set_orb(p, dn_offset, false);
       new_det.set_orb(q, dn_offset, false);
       new_det.set_orb(r, dn_offset, true);
@@ -342,4 +570,12 @@ std::list<Det> HEGSolver::find_connected_dets(const Det& det, const double eps)
   }
 
   return connected_dets;
-};
+}
+
+template class HEGSolver<1>;
+template class HEGSolver<2>;
+template class HEGSolver<4>;
+template class HEGSolver<8>;
+template class HEGSolver<16>;
+template class HEGSolver<32>;
+template class HEGSolver<64>;
@@ -1,46 +1,164 @@
 #ifndef HEG_SOLVER_H_
 #define HEG_SOLVER_H_
 
-#include <boost/functional/hash.hpp>
+#include "../array_math.h"
+#include "../parallel.h"
 #include "../solver/solver.h"
+#include "../span.h"
 #include "../std.h"
 
-class HEGSolver : public Solver {
+template <size_t N>
+class HEGSolver : public Solver<HEGSolver<N>, N> {
  public:
-  static void run() { HEGSolver::get_instance().solve(); }
+  // The two stages hand off through the var_*.txt files, so each may use its own det width.
+  static void run_variation() { HEGSolver<N>::get_instance().solve_variation(); }
 
-  void solve() override;
+  static void run_perturbation() { HEGSolver<N>::get_instance().solve_perturbation(); }
+
+  void solve_variation();
+
+  void solve_perturbation();
+
+  // Sets up the basis of rcut from explicit parameters instead of the config. The same-spin HCI
+  // queues are built lazily on use, so no MPI is needed, e.g. in tests.
+  void setup_lazy(
+      const size_t n_up,
+      const size_t n_dn,
+      const double r_s,
+      const double rcut,
+      const double eps,
+      const bool sparse_hamiltonian = false);
+
+  // Selects and diagonalizes from the current wf, or HF, until converged at eps.
+  using Solver<HEGSolver<N>, N>::variation;
+
+  size_t get_n_orbs() const { return k_points.size(); }
+
+  const std::vector<std::array<int8_t, 3>>& get_k_points() const { return k_points; }
+
+  double get_coulomb(const Orbital p, const Orbital q) const {
+    return coulomb_table[squared_norm(cast<int>(k_points[p]) - cast<int>(k_points[q]))];
+  }
+
+  // Bound of |H| over all the connections, from the opposite-spin HCI queue.
+  double get_max_abs_H() const { return max_abs_H; }
+
+  double hamiltonian(const Det<N>&, const Det<N>&) const;
+
+  // Off-diagonal element between det and its double excitation p, q -> r, s, where p -> r and
+  // q -> s conserve spin. Momentum conservation is assumed.
+  double hamiltonian_from_excitation(
+      const Det<N>& det, const Orbital p, const Orbital q, const Orbital r, const Orbital s) const;
+
+  // Connected dets with the excitations that generate them from the det passed in. Thread safe,
+  // also in lazy mode.
+  std::list<std::pair<Det<N>, Excitation>> find_connected_dets(
+      const Det<N>&, const double eps) const;
+
+  // Diagonal element of the det excited from a det whose diagonal element is known, O(n_elecs).
+  double get_excited_diagonal(const Det<N>&, const double diagonal, const Excitation&) const;
 
  private:
+  friend class Solver<HEGSolver<N>, N>;
+  friend class HelperStrings<HEGSolver<N>, N>;
+
+  using Solver<HEGSolver<N>, N>::n_up;
+  using Solver<HEGSolver<N>, N>::n_dn;
+  using Solver<HEGSolver<N>, N>::max_abs_H;
+  using Solver<HEGSolver<N>, N>::wf;
+  using Solver<HEGSolver<N>, N>::sparse_hamiltonian;
+  using Solver<HEGSolver<N>, N>::save_variation_result;
+  using Solver<HEGSolver<N>, N>::load_variation_result;
+  using Solver<HEGSolver<N>, N>::clear_wf;
+
+  typedef std::pair<std::array<int8_t, 3>, double> HCIQueueItem;  // diff_pr, |H|.
+
+  // Packed k differences with their |H| in descending order. Several queues may be stored
+  // back to back, delimited by an offsets array.
+  struct HCIQueue {
+    std::vector<std::array<int8_t, 3>> diffs;
+    std::vector<float> values;
+  };
+
+  struct HCIQueueView {
+    Span<std::array<int8_t, 3>> diffs;
+    Span<float> values;
+  };
+
+  static constexpr Orbital K_GRID_NONE = std::numeric_limits<Orbital>::max();
+
   double k_unit;
   double H_unit;
   std::vector<double> rcut_vars;
   std::vector<double> eps_vars;
   std::vector<std::array<int8_t, 3>> k_points;
-  std::unordered_map<std::array<int8_t, 3>, std::size_t, boost::hash<std::array<int8_t, 3>>> k_lut;
-  std::unordered_map<
-      std::array<int8_t, 3>,
-      std::vector<std::pair<std::array<int8_t, 3>, double>>,
-      boost::hash<std::array<int8_t, 3>>>
-      same_spin_hci_queue;  // O(k_points^2).
-  std::vector<std::pair<std::array<int8_t, 3>, double>> opposite_spin_hci_queue;  // O(k_points).
-
-  static HEGSolver get_instance() {
-    static HEGSolver heg_solver;
+  std::vector<double> one_body_energies;  // Kinetic energy of each orbital.
+  std::vector<double> coulomb_table;  // H_unit / |k_p - k_q|^2 by |k_p - k_q|^2, 0 at 0.
+  int k_grid_n_max;  // The grid covers [-k_grid_n_max, k_grid_n_max] in each dimension.
+  size_t k_grid_width;
+  std::vector<Orbital> k_grid;  // Orbital of each packed k, or K_GRID_NONE.
+  std::vector<std::array<int8_t, 3>> k_diffs;
+  double hci_queue_rcut;
+  double hci_queue_eps;  // Smallest eps of the stage, below which the queues are truncated.
+
+  // Queues of the canonical diff_pq in CSR layout, indexed by packed k, see KPointsUtil. The
+  // items are stored once per node, with three int8 per diff.
+  std::vector<size_t> same_spin_hci_queue_offsets;
+  NodeSharedArray<int8_t> same_spin_hci_queue_diffs;
+  NodeSharedArray<float> same_spin_hci_queue_values;
+  HCIQueue opposite_spin_hci_queue;  // O(k_points).
+
+  // Lazy mode builds each queue on first use, keeps at most lazy_hci_queue_max_items items over
+  // all the threads and evicts the oldest queues first. Each thread has its own queues, so that
+  // none is evicted while another thread reads it.
+  struct LazyHCIQueueCache {
+    std::unordered_map<size_t, HCIQueue> queues;  // By packed k of diff_pq.
+    std::deque<size_t> order;
+    size_t n_items;
+  };
+
+  bool lazy_hci_queue;
+  size_t lazy_hci_queue_max_items;
+  mutable std::vector<LazyHCIQueueCache> lazy_hci_queue_caches;  // Per thread.
+
+  static HEGSolver<N>& get_instance() {
+    static HEGSolver<N> heg_solver;
     return heg_solver;
   }
 
-  void setup(const double rcut);
+  void load_config();
+
+  // Frees the wavefunction and everything set up for the last rcut. Collective.
+  void release();
+
+  // The HCI queues are truncated at hci_queue_eps, the smallest eps of the stage.
+  void setup(const double rcut, const double hci_queue_eps);
+
+  // k points and matrix element tables.
+  void setup_basis(const double rcut, const double r_s);
+
+  void generate_k_grid();
+
+  // Packed index of k in the dense grid. k must be within the grid.
+  size_t get_k_index(const std::array<int8_t, 3>& k) const {
+    return ((k[0] + k_grid_n_max) * k_grid_width + (k[1] + k_grid_n_max)) * k_grid_width +
+           (k[2] + k_grid_n_max);
+  }
+
+  void generate_matrix_element_tables();
 
+  // Uses hci_queue_eps and the lazy mode settings set beforehand.
   void generate_hci_queue(const double rcut);
 
-  double hamiltonian(const Det&, const Det&) const override;
+  // Sorts items by descending |H| into queue.
+  static void fill_hci_queue(std::vector<HCIQueueItem>& items, HCIQueue& queue);
 
-  int get_gamma_exp(const SpinDet&, const std::vector<uint16_t>& eor) const;
+  void generate_same_spin_hci_queue(const std::array<int8_t, 3>& diff_pq, HCIQueue& queue) const;
 
-  std::list<Det> find_connected_dets(const Det&, const double eps) const override;
+  // Queue of a canonical diff_pq. In lazy mode, valid until the next call on the same thread.
+  HCIQueueView get_same_spin_hci_queue(const std::array<int8_t, 3>& diff_pq) const;
 
-  std::list<OrbitalPair> get_pq_pairs(const Det&, const Orbital dn_offset) const;
+  std::list<OrbitalPair> get_pq_pairs(const Det<N>&, const Orbital dn_offset) const;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,201 @@
+#include "heg_solver.h"
+#include "../array_math.h"
+#include "gtest/gtest.h"
+
+class HEGSolverTest : public ::testing::Test {
+ protected:
+  static constexpr size_t N_ELECS = 5;
+
+  static constexpr double R_S = 1.0;
+
+  HEGSolver<1> solver;
+
+  double H_unit;
+
+  void SetUp() override {
+    solver.setup_lazy(N_ELECS, N_ELECS, R_S, 1.5, 1.0e-6);
+    const double density = 3.0 / (4.0 * M_PI * pow(R_S, 3));
+    const double cell_length = pow(N_ELECS * 2 / density, 1.0 / 3);
+    H_unit = 1.0 / (M_PI * cell_length);
+  }
+
+  bool conserves_momentum(const Orbital p, const Orbital q, const Orbital r, const Orbital s) {
+    const auto& k = solver.get_k_points();
+    return k[p] + k[q] == k[r] + k[s];
+  }
+
+  double get_coulomb(const Orbital p, const Orbital q) const {
+    const auto& k = solver.get_k_points();
+    return H_unit / squared_norm(cast<int>(k[p]) - cast<int>(k[q]));
+  }
+
+  // Number of occupied orbitals below each orbital of eor that is occupied in spin_det.
+  static int get_gamma_exp(const SpinDet<1>& spin_det, const SpinDet<1>& eor) {
+    int gamma_exp = 0;
+    const auto& occ = spin_det.get_elec_orbs();
+    for (const auto orb : eor.get_elec_orbs()) {
+      if (!spin_det.get_orb(orb)) continue;
+      gamma_exp += std::lower_bound(occ.begin(), occ.end(), orb) - occ.begin();
+    }
+    return gamma_exp;
+  }
+
+  // Double excitation element from second quantization, without the solver's phase shortcuts.
+  double brute_force_hamiltonian(const Det<1>& det, const Det<1>& child) const {
+    SpinDet<1> eor_up, eor_dn;
+    eor_up.from_eor(det.up, child.up);
+    eor_dn.from_eor(det.dn, child.dn);
+    std::vector<Orbital> removed, added;
+    for (const auto orb : eor_up.get_elec_orbs()) {
+      (det.up.get_orb(orb) ? removed : added).push_back(orb);
+    }
+    for (const auto orb : eor_dn.get_elec_orbs()) {
+      (det.dn.get_orb(orb) ? removed : added).push_back(orb);
+    }
+    double H = get_coulomb(removed[0], added[0]);
+    if (eor_up.get_elec_orbs().size() != 2) H -= get_coulomb(removed[0], added[1]);
+    const int gamma_exp = get_gamma_exp(det.up, eor_up) + get_gamma_exp(det.dn, eor_dn) +
+                          get_gamma_exp(child.up, eor_up) + get_gamma_exp(child.dn, eor_dn);
+    return (gamma_exp & 1) == 1 ? -H : H;
+  }
+};
+
+TEST_F(HEGSolverTest, ExcitationMatchesBruteForceInEitherPairing) {
+  const size_t n_orbs = solver.get_n_orbs();
+  Det<1> det;
+  for (Orbital i = 0; i < N_ELECS; i++) {
+    det.up.set_orb(i, true);
+    det.dn.set_orb(i + 2, true);
+  }
+
+  // Same-spin doubles. Some vanish by symmetry, the rest come in both signs.
+  size_t n_positive = 0;
+  size_t n_negative = 0;
+  for (Orbital p = 0; p < N_ELECS; p++) {
+    for (Orbital q = p + 1; q < N_ELECS; q++) {
+      for (Orbital r = N_ELECS; r < n_orbs; r++) {
+        for (Orbital s = r + 1; s < n_orbs; s++) {
+          if (!conserves_momentum(p, q, r, s)) continue;
+          Det<1> child(det);
+          child.up.set_orb(p, false);
+          child.up.set_orb(q, false);
+          child.up.set_orb(r, true);
+          child.up.set_orb(s, true);
+          const double H = brute_force_hamiltonian(det, child);
+          EXPECT_DOUBLE_EQ(solver.hamiltonian(det, child), H);
+          EXPECT_DOUBLE_EQ(solver.hamiltonian_from_excitation(det, p, q, r, s), H);
+          EXPECT_DOUBLE_EQ(solver.hamiltonian_from_excitation(det, p, q, s, r), H);
+          EXPECT_DOUBLE_EQ(solver.hamiltonian_from_excitation(det, q, p, r, s), H);
+          if (H > 0.0) n_positive++;
+          if (H < 0.0) n_negative++;
+        }
+      }
+    }
+  }
+  EXPECT_GT(n_positive, 0u);
+  EXPECT_GT(n_negative, 0u);
+
+  // Opposite-spin doubles, in both spin orders.
+  n_positive = 0;
+  n_negative = 0;
+  const Orbital dn_offset = n_orbs;
+  for (Orbital p = 0; p < N_ELECS; p++) {
+    for (Orbital q = 2; q < N_ELECS + 2; q++) {
+      for (Orbital r = N_ELECS; r < n_orbs; r++) {
+        for (Orbital s = 0; s < n_orbs; s++) {
+          if (det.dn.get_orb(s) || !conserves_momentum(p, q, r, s)) continue;
+          Det<1> child(det);
+          child.up.set_orb(p, false);
+          child.up.set_orb(r, true);
+          child.dn.set_orb(q, false);
+          child.dn.set_orb(s, true);
+          const double H = brute_force_hamiltonian(det, child);
+          EXPECT_DOUBLE_EQ(solver.hamiltonian(det, child), H);
+          EXPECT_DOUBLE_EQ(
+              solver.hamiltonian_from_excitation(det, p, q + dn_offset, r, s + dn_offset), H);
+          EXPECT_DOUBLE_EQ(
+              solver.hamiltonian_from_excitation(det, q + dn_offset, p, s + dn_offset, r), H);
+          if (H > 0.0) n_positive++;
+          if (H < 0.0) n_negative++;
+        }
+      }
+    }
+  }
+  EXPECT_GT(n_positive, 0u);
+  EXPECT_GT(n_negative, 0u);
+}
+
+TEST_F(HEGSolverTest, ExcitedDiagonalMatchesHamiltonian) {
+  const Orbital dn_offset = solver.get_n_orbs();
+  Det<1> det;
+  for (Orbital i = 0; i < N_ELECS; i++) {
+    det.up.set_orb(i, true);
+    det.dn.set_orb(i + 2, true);
+  }
+  const double diagonal = solver.hamiltonian(det, det);
+
+  // Same-spin up, same-spin dn, and opposite-spin with the up orbital below or above the dn one.
+  std::array<size_t, 4> n_checked;
+  n_checked.fill(0);
+  for (const auto& connected : solver.find_connected_dets(det, 1.0e-6)) {
+    const auto& child = connected.first;
+    const auto& exc = connected.second;
+    const double child_diagonal = solver.hamiltonian(child, child);
+    EXPECT_NEAR(solver.get_excited_diagonal(det, diagonal, exc), child_diagonal, 1.0e-10);
+    if (exc[1] < dn_offset) {
+      n_checked[0]++;
+    } else if (exc[0] >= dn_offset) {
+      n_checked[1]++;
+    } else {
+      n_checked[exc[0] < exc[1] - dn_offset ? 2 : 3]++;
+      const Excitation dn_first = {exc[1], exc[0], exc[3], exc[2]};
+      EXPECT_NEAR(solver.get_excited_diagonal(det, diagonal, dn_first), child_diagonal, 1.0e-10);
+    }
+  }
+  for (const size_t n : n_checked) EXPECT_GT(n, 0u);
+}
+
+TEST(HEGSolverLargeBasisTest, MaxAbsHMatchesCoulombTable) {
+  // |k_p - k_q|^2 reaches 256 at rcut 8, which wraps to 0 in int8.
+  HEGSolver<64> solver;
+  solver.setup_lazy(5, 5, 1.0, 8.0, 1.0e-6);
+  const size_t n_orbs = solver.get_n_orbs();
+  double max_coulomb = 0.0;
+  for (Orbital p = 0; p < n_orbs; p++) {
+    for (Orbital q = 0; q < n_orbs; q++) {
+      max_coulomb = std::max(max_coulomb, solver.get_coulomb(p, q));
+    }
+  }
+  EXPECT_TRUE(std::isfinite(solver.get_max_abs_H()));
+  EXPECT_DOUBLE_EQ(solver.get_max_abs_H(), max_coulomb);
+}
+
+TEST_F(HEGSolverTest, LazyQueuesFromThreadsMatchSerial) {
+  Det<1> det_hf;
+  for (Orbital i = 0; i < N_ELECS; i++) {
+    det_hf.up.set_orb(i, true);
+    det_hf.dn.set_orb(i, true);
+  }
+  std::vector<Det<1>> dets(1, det_hf);
+  for (const auto& connected : solver.find_connected_dets(det_hf, 1.0e-3)) {
+    dets.push_back(connected.first);
+  }
+
+  // A fresh solver, so that the threads build the lazy queues concurrently.
+  HEGSolver<1> threaded_solver;
+  threaded_solver.setup_lazy(N_ELECS, N_ELECS, R_S, 1.5, 1.0e-6);
+  std::vector<std::vector<Excitation>> excitations(dets.size());
+#pragma omp parallel for schedule(dynamic, 1)
+  for (size_t i = 0; i < dets.size(); i++) {
+    for (const auto& connected : threaded_solver.find_connected_dets(dets[i], 1.0e-6)) {
+      excitations[i].push_back(connected.second);
+    }
+  }
+  for (size_t i = 0; i < dets.size(); i++) {
+    std::vector<Excitation> expected;
+    for (const auto& connected : solver.find_connected_dets(dets[i], 1.0e-6)) {
+      expected.push_back(connected.second);
+    }
+    EXPECT_EQ(excitations[i], expected);
+  }
+}
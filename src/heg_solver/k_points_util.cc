@@ -1,6 +1,5 @@
 #include "k_points_util.h"
 
-#include <boost/functional/hash.hpp>
 #include "../array_math.h"
 
 size_t KPointsUtil::get_n_k_points(const double rcut) {
@@ -39,17 +38,26 @@ std::vector<std::array<int8_t, 3>> KPointsUtil::generate_k_points(const double r
 
 std::vector<std::array<int8_t, 3>> KPointsUtil::get_k_diffs(
     const std::vector<std::array<int8_t, 3>>& k_points) {
-  // Generate all possible differences between two different k points.
-  std::unordered_set<std::array<int8_t, 3>, boost::hash<std::array<int8_t, 3>>> k_diffs_set;
+  // Generate all possible differences between two different k points, deduplicated with a
+  // dense grid over [-2 n_max, 2 n_max]^3.
+  int n_max = 0;
+  for (const auto& k : k_points) {
+    for (const auto k_i : k) n_max = std::max(n_max, std::abs(static_cast<int>(k_i)));
+  }
+  const int offset = n_max * 2;
+  const size_t width = offset * 2 + 1;
+  std::vector<bool> seen(width * width * width, false);
   std::vector<std::array<int8_t, 3>> k_diffs;
   const size_t n_orbs = k_points.size();
   for (size_t p = 0; p < n_orbs; p++) {
     for (size_t q = 0; q < n_orbs; q++) {
       if (p == q) continue;
       const auto& diff_pq = k_points[q] - k_points[p];
-      if (k_diffs_set.count(diff_pq) == 1) continue;
+      const size_t id =
+          ((diff_pq[0] + offset) * width + (diff_pq[1] + offset)) * width + (diff_pq[2] + offset);
+      if (seen[id]) continue;
       k_diffs.push_back(diff_pq);
-      k_diffs_set.insert(diff_pq);
+      seen[id] = true;
     }
   }
 
@@ -58,7 +66,7 @@ std::vector<std::array<int8_t, 3>> KPointsUtil::get_k_diffs(
       k_diffs.begin(),
       k_diffs.end(),
       [](const std::array<int8_t, 3>& a, const std::array<int8_t, 3>& b) -> bool {
-        return squared_norm(a) < squared_norm(b);
+        return squared_norm(cast<int>(a)) < squared_norm(cast<int>(b));
       });
 
   return k_diffs;
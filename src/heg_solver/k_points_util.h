@@ -3,8 +3,49 @@
 
 #include "../std.h"
 
+// Cubic lattice symmetry operation, i.e. an axis permutation with sign flips.
+struct KSymmetryOp {
+  std::array<int8_t, 3> perm;
+  std::array<int8_t, 3> sign;
+
+  std::array<int8_t, 3> apply(const std::array<int8_t, 3>& k) const {
+    return {{static_cast<int8_t>(sign[0] * k[perm[0]]),
+             static_cast<int8_t>(sign[1] * k[perm[1]]),
+             static_cast<int8_t>(sign[2] * k[perm[2]])}};
+  }
+
+  std::array<int8_t, 3> apply_inverse(const std::array<int8_t, 3>& k) const {
+    std::array<int8_t, 3> res;
+    for (int i = 0; i < 3; i++) res[perm[i]] = sign[i] * k[i];
+    return res;
+  }
+};
+
 class KPointsUtil {
  public:
+  // Whether k is the representative of its O_h orbit, i.e. k[0] >= k[1] >= k[2] >= 0.
+  static bool is_canonical(const std::array<int8_t, 3>& k) {
+    return k[0] >= k[1] && k[1] >= k[2] && k[2] >= 0;
+  }
+
+  // Symmetry operation that maps k to its canonical representative.
+  static KSymmetryOp get_canonical_op(const std::array<int8_t, 3>& k) {
+    KSymmetryOp op;
+    std::array<int8_t, 3> abs_k;
+    for (int i = 0; i < 3; i++) {
+      op.perm[i] = i;
+      op.sign[i] = k[i] < 0 ? -1 : 1;
+      abs_k[i] = op.sign[i] * k[i];
+    }
+    // Three element sorting network on the absolute values, descending.
+    if (abs_k[op.perm[0]] < abs_k[op.perm[1]]) std::swap(op.perm[0], op.perm[1]);
+    if (abs_k[op.perm[1]] < abs_k[op.perm[2]]) std::swap(op.perm[1], op.perm[2]);
+    if (abs_k[op.perm[0]] < abs_k[op.perm[1]]) std::swap(op.perm[0], op.perm[1]);
+    const std::array<int8_t, 3> sign = op.sign;
+    for (int i = 0; i < 3; i++) op.sign[i] = sign[op.perm[i]];
+    return op;
+  }
+
   static size_t get_n_k_points(const double);
 
   static std::vector<std::array<int8_t, 3>> generate_k_points(const double);
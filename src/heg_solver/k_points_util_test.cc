@@ -0,0 +1,15 @@
+#include "k_points_util.h"
+#include "gtest/gtest.h"
+
+TEST(KPointsUtilTest, CanonicalOp) {
+  const std::array<int8_t, 3> k({{-1, 3, -2}});
+  const auto& op = KPointsUtil::get_canonical_op(k);
+  const auto& k_canonical = op.apply(k);
+  EXPECT_EQ(k_canonical, (std::array<int8_t, 3>({{3, 2, 1}})));
+  EXPECT_TRUE(KPointsUtil::is_canonical(k_canonical));
+  EXPECT_EQ(op.apply_inverse(k_canonical), k);
+
+  // Other vectors transform back consistently.
+  const std::array<int8_t, 3> k_other({{1, -2, 0}});
+  EXPECT_EQ(op.apply_inverse(op.apply(k_other)), k_other);
+}
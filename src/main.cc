@@ -4,11 +4,49 @@
 
 #include "config.h"
 #include "heg_solver/heg_solver.h"
+#include "heg_solver/k_points_util.h"
 #include "omp.h"
 #include "parallel.h"
 #include "std.h"
 #include "time.h"
 
+// Number of orbitals per spin of the largest basis set up with rcut_vars scaled by ratio.
+size_t get_heg_n_orbs(const double rcut_ratio) {
+  const auto& rcut_vars = Config::get_array<double>("rcut_vars");
+  const double rcut_max = *std::max_element(rcut_vars.begin(), rcut_vars.end()) * rcut_ratio;
+  return KPointsUtil::generate_k_points(rcut_max).size();
+}
+
+template <size_t N>
+void run_heg_stage(const bool perturbation) {
+  if (perturbation) {
+    HEGSolver<N>::run_perturbation();
+  } else {
+    HEGSolver<N>::run_variation();
+  }
+}
+
+// Run a stage with the narrowest spin det that fits n_orbs orbitals.
+void run_heg(const size_t n_orbs, const bool perturbation) {
+  if (n_orbs <= SpinDet<1>::N_ORBS_MAX) {
+    run_heg_stage<1>(perturbation);
+  } else if (n_orbs <= SpinDet<2>::N_ORBS_MAX) {
+    run_heg_stage<2>(perturbation);
+  } else if (n_orbs <= SpinDet<4>::N_ORBS_MAX) {
+    run_heg_stage<4>(perturbation);
+  } else if (n_orbs <= SpinDet<8>::N_ORBS_MAX) {
+    run_heg_stage<8>(perturbation);
+  } else if (n_orbs <= SpinDet<16>::N_ORBS_MAX) {
+    run_heg_stage<16>(perturbation);
+  } else if (n_orbs <= SpinDet<32>::N_ORBS_MAX) {
+    run_heg_stage<32>(perturbation);
+  } else if (n_orbs <= SpinDet<64>::N_ORBS_MAX) {
+    run_heg_stage<64>(perturbation);
+  } else {
+    throw std::invalid_argument("Too many orbitals");
+  }
+}
+
 int main(int argc, char** argv) {
 #ifndef SERIAL
   boost::mpi::environment env(argc, argv);  // For MPI 1.1.
@@ -32,7 +70,14 @@ int main(int argc, char** argv) {
 
   const std::string& type = Config::get<std::string>("type");
   if (type == "heg") {
-    HEGSolver::run();
+    const size_t n_orbs_var = get_heg_n_orbs(1.0);
+    if (Parallel::is_master()) printf("Max variation orbitals per spin: %zu\n", n_orbs_var);
+    run_heg(n_orbs_var, false);
+    if (!Config::get<bool>("variation_only", false)) {
+      const size_t n_orbs_pt = get_heg_n_orbs(Config::get<double>("rcut_pt_ratio", 1.26));
+      if (Parallel::is_master()) printf("Max perturbation orbitals per spin: %zu\n", n_orbs_pt);
+      run_heg(n_orbs_pt, true);
+    }
   } else {
     throw std::invalid_argument("System type not supported");
   }
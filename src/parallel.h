@@ -3,6 +3,8 @@
 
 #ifndef SERIAL
 #include <boost/mpi.hpp>
+#include <boost/serialization/string.hpp>
+#include <boost/serialization/vector.hpp>
 #endif
 #include "omp.h"
 #include "std.h"
@@ -19,16 +21,25 @@ class vector_plus : public std::binary_function<std::vector<T>, std::vector<T>,
   }
 };
 
+template <class T>
+class NodeSharedArray;
+
 class Parallel {
  private:
   size_t id;
   size_t n;
   boost::mpi::environment* env;  // For MPI 1.1.
   boost::mpi::communicator world;
+  boost::mpi::communicator node;  // Procs sharing memory with this one.
+  boost::mpi::communicator leaders;  // Procs of the same node rank, e.g. the first of each node.
 
   Parallel() {
     id = world.rank();
     n = world.size();
+    MPI_Comm node_comm;
+    MPI_Comm_split_type(world, MPI_COMM_TYPE_SHARED, id, MPI_INFO_NULL, &node_comm);
+    node = boost::mpi::communicator(node_comm, boost::mpi::comm_take_ownership);
+    leaders = world.split(node.rank());
   }
 
   // Singleton pattern boilerplate.
@@ -79,6 +90,103 @@ class Parallel {
     std::vector<T> t_local = t;
     boost::mpi::all_reduce(Parallel::get_instance().world, t_local, t, vector_plus<T>());
   }
+
+  // res[i] is the t of proc i.
+  template <class T>
+  static void all_gather(const T& t, std::vector<T>& res) {
+    boost::mpi::all_gather(Parallel::get_instance().world, t, res);
+  }
+
+  template <class T>
+  friend class NodeSharedArray;
+};
+
+// Zero-initialized array stored once per node in an MPI shared memory window. Every proc of the
+// node reads and writes the same elements.
+template <class T>
+class NodeSharedArray {
+ public:
+  NodeSharedArray() : ptr(nullptr), n(0), allocated(false) {}
+
+  NodeSharedArray(const NodeSharedArray&) = delete;
+
+  NodeSharedArray& operator=(const NodeSharedArray&) = delete;
+
+  ~NodeSharedArray() {
+    int finalized;
+    MPI_Finalized(&finalized);
+    if (!finalized) free();
+  }
+
+  // Replaces the array with n zeros. Collective.
+  void allocate(const size_t n) {
+    free();
+    const boost::mpi::communicator& node = Parallel::get_instance().node;
+    const MPI_Aint n_bytes = node.rank() == 0 ? n * sizeof(T) : 0;
+    T* local_ptr;
+    MPI_Win_allocate_shared(n_bytes, sizeof(T), MPI_INFO_NULL, node, &local_ptr, &win);
+    MPI_Aint size;
+    int disp_unit;
+    MPI_Win_shared_query(win, 0, &size, &disp_unit, &ptr);
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, win);
+    allocated = true;
+    this->n = n;
+    if (node.rank() == 0) std::fill(ptr, ptr + n, T());
+    sync();
+  }
+
+  // Frees the array. Collective.
+  void clear() { free(); }
+
+  size_t size() const { return n; }
+
+  T* data() { return ptr; }
+
+  const T* data() const { return ptr; }
+
+  // Makes the writes of each proc of the node visible to the others. Collective.
+  void sync() {
+    MPI_Win_sync(win);
+    Parallel::get_instance().node.barrier();
+    MPI_Win_sync(win);
+  }
+
+  // Sums the copies of all the nodes elementwise into each of them. Collective.
+  void reduce_to_sum_across_nodes() {
+    sync();
+    const Parallel& parallel = Parallel::get_instance();
+    if (parallel.node.rank() == 0 && parallel.leaders.size() > 1) {
+      const size_t chunk = std::numeric_limits<int>::max();
+      for (size_t offset = 0; offset < n; offset += chunk) {
+        MPI_Allreduce(
+            MPI_IN_PLACE,
+            ptr + offset,
+            std::min(chunk, n - offset),
+            boost::mpi::get_mpi_datatype<T>(),
+            MPI_SUM,
+            parallel.leaders);
+      }
+    }
+    sync();
+  }
+
+ private:
+  T* ptr;
+
+  size_t n;
+
+  bool allocated;
+
+  MPI_Win win;
+
+  void free() {
+    if (!allocated) return;
+    MPI_Win_unlock_all(win);
+    MPI_Win_free(&win);
+    ptr = nullptr;
+    n = 0;
+    allocated = false;
+  }
 };
 
 #else
@@ -99,7 +207,36 @@ class Parallel {
   static void print_info() { printf("Running in serial.\n"); }
 
   template <class T>
-  static void reduce_to_sum(T& t) {}
+  static void reduce_to_sum(T&) {}
+
+  template <class T>
+  static void reduce_to_sum_vector(std::vector<T>&) {}
+
+  template <class T>
+  static void all_gather(const T& t, std::vector<T>& res) {
+    res.assign(1, t);
+  }
+};
+
+template <class T>
+class NodeSharedArray {
+ public:
+  void allocate(const size_t n) { std::vector<T>(n).swap(array); }
+
+  void clear() { std::vector<T>().swap(array); }
+
+  size_t size() const { return array.size(); }
+
+  T* data() { return array.data(); }
+
+  const T* data() const { return array.data(); }
+
+  void sync() {}
+
+  void reduce_to_sum_across_nodes() {}
+
+ private:
+  std::vector<T> array;
 };
 
 #endif  // SERIAL
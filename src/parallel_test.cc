@@ -0,0 +1,37 @@
+#include "parallel.h"
+#include "gtest/gtest.h"
+
+#ifndef SERIAL
+// For the tests that run the solvers, which synchronize and reduce across the procs.
+class MPIEnvironment : public ::testing::Environment {
+ public:
+  void SetUp() override {
+    env.reset(new boost::mpi::environment());
+    Parallel::init(*env);
+  }
+
+  void TearDown() override { env.reset(); }
+
+ private:
+  std::unique_ptr<boost::mpi::environment> env;
+};
+
+static ::testing::Environment* const mpi_environment =
+    ::testing::AddGlobalTestEnvironment(new MPIEnvironment());
+#endif
+
+TEST(ParallelTest, ReduceAndGather) {
+  const size_t n_procs = Parallel::get_n();
+  size_t n = 1;
+  Parallel::reduce_to_sum(n);
+  EXPECT_EQ(n, n_procs);
+
+  std::vector<double> vec(2, 1.0);
+  Parallel::reduce_to_sum_vector(vec);
+  EXPECT_DOUBLE_EQ(vec[1], n_procs);
+
+  std::vector<size_t> ids;
+  Parallel::all_gather(Parallel::get_id(), ids);
+  ASSERT_EQ(ids.size(), n_procs);
+  for (size_t i = 0; i < n_procs; i++) EXPECT_EQ(ids[i], i);
+}
@@ -0,0 +1,60 @@
+#ifndef SMALL_VECTOR_H_
+#define SMALL_VECTOR_H_
+
+#include "std.h"
+
+// Vector that keeps up to CAPACITY elements inline and only spills to the heap beyond that.
+// T should be trivially copyable.
+template <class T, size_t CAPACITY>
+class SmallVector {
+ public:
+  SmallVector() : n(0) {}
+
+  size_t size() const { return n; }
+
+  bool empty() const { return n == 0; }
+
+  void push_back(const T& value) {
+    if (n < CAPACITY) {
+      inline_data[n] = value;
+    } else {
+      if (n == CAPACITY) heap_data.assign(inline_data.begin(), inline_data.end());
+      heap_data.push_back(value);
+    }
+    n++;
+  }
+
+  void clear() {
+    n = 0;
+    heap_data.clear();
+  }
+
+  T* data() { return n > CAPACITY ? heap_data.data() : inline_data.data(); }
+
+  const T* data() const { return n > CAPACITY ? heap_data.data() : inline_data.data(); }
+
+  T& operator[](const size_t i) { return data()[i]; }
+
+  const T& operator[](const size_t i) const { return data()[i]; }
+
+  T* begin() { return data(); }
+
+  T* end() { return data() + n; }
+
+  const T* begin() const { return data(); }
+
+  const T* end() const { return data() + n; }
+
+  const T& front() const { return data()[0]; }
+
+  const T& back() const { return data()[n - 1]; }
+
+ private:
+  size_t n;
+
+  std::array<T, CAPACITY> inline_data;
+
+  std::vector<T> heap_data;
+};
+
+#endif
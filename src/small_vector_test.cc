@@ -0,0 +1,28 @@
+#include "small_vector.h"
+#include "gtest/gtest.h"
+
+TEST(SmallVectorTest, InlineElements) {
+  SmallVector<int, 4> vec;
+  EXPECT_TRUE(vec.empty());
+  for (int i = 0; i < 4; i++) vec.push_back(i * 2);
+  EXPECT_EQ(vec.size(), 4);
+  EXPECT_EQ(vec.front(), 0);
+  EXPECT_EQ(vec.back(), 6);
+  EXPECT_EQ(vec[2], 4);
+}
+
+TEST(SmallVectorTest, SpillToHeap) {
+  SmallVector<int, 4> vec;
+  for (int i = 0; i < 10; i++) vec.push_back(i);
+  EXPECT_EQ(vec.size(), 10);
+  int sum = 0;
+  for (const int value : vec) sum += value;
+  EXPECT_EQ(sum, 45);
+
+  const SmallVector<int, 4> copy = vec;
+  EXPECT_EQ(copy[9], 9);
+  vec.clear();
+  EXPECT_TRUE(vec.empty());
+  vec.push_back(3);
+  EXPECT_EQ(vec.back(), 3);
+}
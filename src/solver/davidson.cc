@@ -2,8 +2,7 @@
 
 #include <Eigen/Dense>
 
-size_t Davidson::diagonalize(
-    const std::vector<double>& initial_vector, std::size_t max_iterations) {
+size_t Davidson::diagonalize(Span<double> initial_vector, std::size_t max_iterations) {
   const double TOLERANCE = 1.0e-7;
 
   if (n == 1) {
@@ -37,14 +36,14 @@ size_t Davidson::diagonalize(
   Eigen::VectorXd work(len_work);
   bool converged = false;
   std::vector<double> tmp_v(n);
+  std::vector<double> tmp_Hv(n);
 
-  // Get diagonal elements.
-  Eigen::VectorXd diag_elems(n);
-  for (std::size_t i = 0; i < n; i++) diag_elems[i] = diagonal[i];
+  // Diagonal elements, viewed in place.
+  Eigen::Map<const Eigen::VectorXd> diag_elems(diagonal.data(), n);
 
   // First iteration.
   for (std::size_t i = 0; i < n; i++) tmp_v[i] = v(i, 0);
-  const auto& tmp_Hv = apply_hamiltonian(tmp_v);
+  apply_hamiltonian(tmp_v, tmp_Hv);
   for (std::size_t i = 0; i < n; i++) Hv(i, 0) = tmp_Hv[i];
   lowest_eigenvalue = v.col(0).dot(Hv.col(0));
   h_krylov(0, 0) = lowest_eigenvalue;
@@ -76,8 +75,8 @@ size_t Davidson::diagonalize(
 
     // Apply H once.
     for (std::size_t i = 0; i < n; i++) tmp_v[i] = v(i, it);
-    const auto& tmp_Hv2 = apply_hamiltonian(tmp_v);
-    for (std::size_t i = 0; i < n; i++) Hv(i, it) = tmp_Hv2[i];
+    apply_hamiltonian(tmp_v, tmp_Hv);
+    for (std::size_t i = 0; i < n; i++) Hv(i, it) = tmp_Hv[i];
 
     // Construct Krylow matrix and diagonalize.
     for (std::size_t i = 0; i <= it; i++) {
@@ -1,14 +1,15 @@
 #ifndef DAVIDSON_H_
 #define DAVIDSON_H_
 
+#include "../span.h"
 #include "../std.h"
 
 // Translated from Adam's fortran code.
 class Davidson {
  public:
   Davidson(
-      std::vector<double>& diagonal,
-      std::function<std::vector<double>(std::vector<double>)>& apply_hamiltonian,
+      Span<double> diagonal,
+      std::function<void(const std::vector<double>&, std::vector<double>&)>& apply_hamiltonian,
       const std::size_t n)
       : diagonal(diagonal), apply_hamiltonian(apply_hamiltonian) {
     this->n = n;
@@ -18,7 +19,7 @@ class Davidson {
 
   void set_verbose(const bool verbose) { this->verbose = verbose; }
 
-  size_t diagonalize(const std::vector<double>& initial_vector, std::size_t max_iterations = 5);
+  size_t diagonalize(Span<double> initial_vector, std::size_t max_iterations = 5);
 
   double get_lowest_eigenvalue() {
     if (!diagonalized) throw std::runtime_error("Accessing eigenvalue before diagonalization.");
@@ -32,8 +33,9 @@ class Davidson {
 
  private:
   // Use functional programming to allow either direct or indirect evaluation.
-  std::vector<double>& diagonal;
-  std::function<std::vector<double>(std::vector<double>)>& apply_hamiltonian;
+  // apply_hamiltonian(v, Hv) writes H * v into the caller-provided Hv.
+  Span<double> diagonal;
+  std::function<void(const std::vector<double>&, std::vector<double>&)>& apply_hamiltonian;
 
   // Length in each direction.
   std::size_t n;
@@ -12,8 +12,8 @@ class HilbertSystem {
     return -1.0 / GAMMA / (i + j + 1);
   }
 
-  std::vector<double> apply_hamiltonian(const std::vector<double>& v) {
-    std::vector<double> Hv(n, 0.0);
+  void apply_hamiltonian(const std::vector<double>& v, std::vector<double>& Hv) {
+    Hv.assign(n, 0.0);
     for (int i = 0; i < n; i++) {
       Hv[i] += get_hamiltonian(i, i) * v[i];
       for (int j = i + 1; j < std::min(n, i + 1000); j++) {
@@ -22,7 +22,6 @@ class HilbertSystem {
         Hv[j] += h_ij * v[i];
       }
     }
-    return Hv;
   }
 
  private:
@@ -35,8 +34,12 @@ TEST(DavidsonTest, HilbertSystem) {
   std::vector<double> diagonal(N);
   for (std::size_t i = 0; i < N; i++) diagonal[i] = hamiltonian.get_hamiltonian(i, i);
 
-  std::function<std::vector<double>(std::vector<double>)> apply_hamiltonian =
-      std::bind(&HilbertSystem::apply_hamiltonian, &hamiltonian, std::placeholders::_1);
+  std::function<void(const std::vector<double>&, std::vector<double>&)> apply_hamiltonian =
+      std::bind(
+          &HilbertSystem::apply_hamiltonian,
+          &hamiltonian,
+          std::placeholders::_1,
+          std::placeholders::_2);
 
   Davidson davidson(diagonal, apply_hamiltonian, N);
 
@@ -1,42 +1,170 @@
 #ifndef HCI_HELPER_STRINGS_H_
 #define HCI_HELPER_STRINGS_H_
 
+#include <unistd.h>
 #include <boost/functional/hash.hpp>
+#include "../config.h"
+#include "../parallel.h"
+#include "../span.h"
 #include "../std.h"
 #include "../wavefunction/wavefunction.h"
+#include "omp.h"
 
+// S is the concrete solver, whose hamiltonian is called directly so that it can be inlined.
+template <class S, size_t N>
 class HelperStrings {
  public:
-  HelperStrings(std::function<double(Det, Det)>& hamiltonian) : hamiltonian(hamiltonian) {}
+  HelperStrings(const S& solver)
+      : HelperStrings(
+            solver,
+            Config::get<bool>("sorted_connections", false),
+            Config::get<double>("cache_mb", -1.0)) {}
 
-  void setup(const std::vector<Det>& dets);
+  // cache_mb is the budget per proc, or negative to follow the available memory.
+  HelperStrings(const S& solver, const bool sorted_connections, const double cache_mb)
+      : cache_mb(cache_mb),
+        n_procs_on_host(0),
+        solver(solver),
+        sorted_connections(sorted_connections) {}
 
-  std::vector<std::pair<size_t, double>> find_connections(const std::size_t i);
+  // Indexes the dets appended since the last update. The dets already indexed must be a
+  // prefix of dets, so that the cached connections stay valid. diagonals are the stored
+  // diagonal elements of dets, used instead of evaluating them again.
+  void update(Span<Det<N>> dets, Span<double> diagonals);
+
+  // Connections of det i to the dets j >= i. The result is valid until the next call on the
+  // same thread.
+  const std::vector<std::pair<size_t, double>>& find_connections(const std::size_t i);
+
+  // Connections of det i to the dets j >= max(i, start), bypassing the cache. The result is
+  // valid until the next call on the same thread.
+  const std::vector<std::pair<size_t, double>>& find_connections_from(
+      const std::size_t i, const std::size_t start);
+
+  // Called after each pass over the rows. After the first pass since the last update, keeps the
+  // rows that save the most work per byte within the memory budget. Reports the hit rate.
+  void end_pass();
+
+  // Bytes of the connection cache on this proc.
+  size_t get_cache_used() const { return cache_used; }
+
+  // Candidates scanned plus connections found for row i, over the computations recorded.
+  uint32_t get_row_cost(const size_t i) const { return row_costs[i]; }
 
  private:
-  std::vector<Det> dets;
+  // Views of the dets and their diagonal elements owned by the wavefunction.
+  Span<Det<N>> dets;
+
+  Span<double> diagonals;
 
   std::vector<std::vector<std::pair<size_t, double>>> cached_connections;
 
-  std::vector<bool> cached;
+  // Bytes rather than bits so that threads can update different rows concurrently.
+  std::vector<uint8_t> cached;
+
+  // Number of dets when each cached row was last completed.
+  std::vector<size_t> cached_n_dets;
+
+  // Rows that may be cached, all of them until the first pass is planned.
+  std::vector<uint8_t> cacheable;
+
+  // Candidates scanned and connections found for each row computed, used for planning.
+  std::vector<uint32_t> row_costs;
+
+  std::vector<uint32_t> row_sizes;
+
+  size_t cache_budget;  // Bytes per proc.
+
+  // Fixed budget, or negative to follow the available memory at each update.
+  double cache_mb;
+
+  size_t n_procs_on_host;
+
+  size_t cache_used;
+
+  bool cache_planned;
+
+  size_t n_hits;
+
+  size_t n_extensions;  // Cached rows completed with the connections to new dets.
+
+  size_t n_misses;
+
+  // Connections of the rows not cached, per thread.
+  std::vector<std::vector<std::pair<size_t, double>>> thread_connections;
+
+  const S& solver;
+
+  // Dets, or other strings, grouped by string id in CSR layout. New entries are merged in with
+  // each update.
+  struct StringIndex {
+    std::vector<size_t> offsets;
 
-  size_t cache_size;
+    std::vector<uint32_t> items;  // Det or string ids.
 
-  std::function<double(Det, Det)>& hamiltonian;
+    Span<uint32_t> get(const uint32_t string_id) const {
+      const size_t offset = offsets[string_id];
+      return Span<uint32_t>(items.data() + offset, offsets[string_id + 1] - offset);
+    }
 
-  // alpha and beta strings, O(n_dets).
-  std::unordered_map<
-      Orbitals,
-      std::pair<std::vector<size_t>, std::vector<size_t>>,
-      boost::hash<Orbitals>>
-      ab;
+    // Items not below start, for lists in ascending order.
+    Span<uint32_t> get(const uint32_t string_id, const size_t start) const {
+      const Span<uint32_t> list = get(string_id);
+      const uint32_t* begin = std::lower_bound(list.begin(), list.end(), start);
+      return Span<uint32_t>(begin, list.end() - begin);
+    }
 
-  // alpha-m1 and beta-m1 strings, O(n_dets * n_elecs).
-  std::unordered_map<
-      Orbitals,
-      std::pair<std::vector<size_t>, std::vector<size_t>>,
-      boost::hash<Orbitals>>
-      ab_m1;
+    // Appends (string id, item) entries to the lists of their strings, in place.
+    void merge(const std::vector<std::pair<uint32_t, uint32_t>>& entries, const size_t n_strings);
+  };
+
+  // Dense ids of the unique alpha and beta strings and of the strings with one electron
+  // removed. Only the strings of new dets are hashed.
+  std::unordered_map<SpinDet<N>, uint32_t, boost::hash<SpinDet<N>>> up_ids;
+
+  std::unordered_map<SpinDet<N>, uint32_t, boost::hash<SpinDet<N>>> dn_ids;
+
+  std::unordered_map<SpinDet<N>, uint32_t, boost::hash<SpinDet<N>>> up_m1_ids;
+
+  std::unordered_map<SpinDet<N>, uint32_t, boost::hash<SpinDet<N>>> dn_m1_ids;
+
+  // Alpha and beta string ids of each det.
+  std::vector<uint32_t> det_up_ids;
+
+  std::vector<uint32_t> det_dn_ids;
+
+  // m1 string ids of each alpha and beta string, one per electron in ascending orbital order.
+  std::vector<uint32_t> up_m1_ids_of;
+
+  std::vector<uint32_t> dn_m1_ids_of;
+
+  size_t n_up_elecs;
+
+  size_t n_dn_elecs;
+
+  // alpha, beta, alpha-m1 and beta-m1, O(n_dets * n_elecs) uint32 in total. In sorted mode,
+  // the dets sharing an alpha string are ordered by beta string id.
+  StringIndex dets_by_up;
+
+  StringIndex dets_by_dn;
+
+  StringIndex dets_by_up_m1;
+
+  StringIndex dets_by_dn_m1;
+
+  // Opposite-spin doubles are found by merging the beta-sorted blocks of the alpha singles with
+  // the sorted beta singles, instead of marking candidates.
+  bool sorted_connections;
+
+  // Alpha and beta strings sharing each m1 string, only in sorted mode.
+  StringIndex ups_by_up_m1;
+
+  StringIndex dns_by_dn_m1;
+
+  // Single excitations of the strings of the current det, per thread.
+  std::vector<std::vector<uint32_t>> up_singles;
+
+  std::vector<std::vector<uint32_t>> dn_singles;
 
   // Whether has been included in the potential connections.
   std::vector<std::vector<bool>> connected;
@@ -44,11 +172,492 @@ class HelperStrings {
   // Whether the variational dets are one-up excitations of the det passed in.
   std::vector<std::vector<bool>> one_up;
 
-  // Setup alpha and beta.
-  void setup_ab();
+  // Assigns the string ids of the dets from start on and merges them into the indices.
+  void setup_strings(const size_t start);
+
+  // Id of a string, registering it and its m1 strings if new. The (m1 id, string id) pairs of
+  // a new string are appended to m1_entries.
+  uint32_t get_string_id(
+      const SpinDet<N>& spin_det,
+      std::unordered_map<SpinDet<N>, uint32_t, boost::hash<SpinDet<N>>>& ids,
+      std::unordered_map<SpinDet<N>, uint32_t, boost::hash<SpinDet<N>>>& m1_ids,
+      std::vector<uint32_t>& m1_ids_of,
+      std::vector<std::pair<uint32_t, uint32_t>>& m1_entries);
 
-  // Setup alpha-m1 and beta-m1.
-  void setup_ab_m1();
+  // Strings that differ from a string by one electron, through the strings sharing its m1s.
+  static void get_singles(
+      const uint32_t string_id,
+      const size_t n_elecs,
+      const std::vector<uint32_t>& m1_ids_of,
+      const StringIndex& strings_by_m1,
+      std::vector<uint32_t>& singles);
+
+  // Sorted mode counterpart of the one up one dn part of add_connections. Returns the number
+  // of merge steps.
+  size_t add_opposite_spin_connections(
+      const size_t i, const size_t start, std::vector<std::pair<size_t, double>>& connections);
+
+  // Appends the connections of det i to the dets j >= start. Returns the candidates scanned
+  // plus the matrix elements evaluated.
+  size_t add_connections(
+      const size_t i, const size_t start, std::vector<std::pair<size_t, double>>& connections);
+
+  // Reserves cache bytes atomically. Returns false if they exceed the budget.
+  bool reserve_cache(const size_t bytes);
+
+  // MemAvailable of this host in bytes.
+  static double get_available_memory();
+
+  static size_t get_n_procs_on_host();
+
+  // Drops the cached rows that save the least work per byte until the cache fits the budget.
+  void shrink_cache();
+
+  // Rows are stored at their exact size, so their capacity is n_connections.
+  static size_t get_row_bytes(const size_t n_connections) {
+    return sizeof(std::vector<std::pair<size_t, double>>) +
+           n_connections * sizeof(std::pair<size_t, double>);
+  }
 };
 
-#endif
\ No newline at end of file
+template <class S, size_t N>
+void HelperStrings<S, N>::update(Span<Det<N>> dets, Span<double> diagonals) {
+  if (dets.size() > std::numeric_limits<uint32_t>::max()) {
+    throw std::invalid_argument("Too many dets for the uint32 det ids.");
+  }
+  const size_t n_dets_old = this->dets.size();
+  this->dets = dets;
+  this->diagonals = diagonals;
+  setup_strings(n_dets_old);
+
+  const size_t n_dets = dets.size();
+  cached.resize(n_dets, 0);
+  cached_n_dets.resize(n_dets, 0);
+  cached_connections.resize(n_dets);
+  row_costs.resize(n_dets, 0);
+  row_sizes.resize(n_dets, 0);
+
+  // Replan after the next pass, starting from the rows cached so far.
+  cacheable.assign(n_dets, 1);
+  cache_used = 0;
+  for (size_t i = 0; i < n_dets_old; i++) {
+    if (cached[i]) cache_used += get_row_bytes(cached_connections[i].capacity());
+  }
+
+  // The rows cached so far plus half of the memory available now, which already accounts for
+  // the growth of the space since the last update.
+  if (cache_mb < 0) {
+    if (n_procs_on_host == 0) n_procs_on_host = get_n_procs_on_host();
+    cache_budget = cache_used + get_available_memory() * 0.5 / n_procs_on_host;
+  } else {
+    cache_budget = cache_mb * 1e6;
+  }
+  if (cache_used > cache_budget) shrink_cache();
+  cache_planned = false;
+  n_hits = n_extensions = n_misses = 0;
+
+#pragma omp parallel
+  {
+    const int thread_id = omp_get_thread_num();
+    if (thread_id == 0) {
+      connected.resize(omp_get_num_threads());
+      one_up.resize(omp_get_num_threads());
+      thread_connections.resize(omp_get_num_threads());
+      up_singles.resize(omp_get_num_threads());
+      dn_singles.resize(omp_get_num_threads());
+    }
+#pragma omp barrier
+    connected[thread_id].resize(n_dets, false);
+    one_up[thread_id].resize(n_dets, false);
+  }
+}
+
+template <class S, size_t N>
+double HelperStrings<S, N>::get_available_memory() {
+  // MemAvailable includes the reclaimable page cache, unlike MemFree.
+  double free_bytes =
+      static_cast<double>(sysconf(_SC_AVPHYS_PAGES)) * static_cast<double>(sysconf(_SC_PAGESIZE));
+  std::ifstream meminfo("/proc/meminfo");
+  std::string key;
+  double value_kb;
+  std::string unit;
+  while (meminfo >> key >> value_kb >> unit) {
+    if (key == "MemAvailable:") {
+      free_bytes = value_kb * 1024;
+      break;
+    }
+  }
+  return free_bytes;
+}
+
+template <class S, size_t N>
+size_t HelperStrings<S, N>::get_n_procs_on_host() {
+  std::vector<std::string> hosts;
+  const std::string host = Parallel::get_host();
+  Parallel::all_gather(host, hosts);
+  return std::count(hosts.begin(), hosts.end(), host);
+}
+
+template <class S, size_t N>
+void HelperStrings<S, N>::shrink_cache() {
+  std::vector<size_t> rows;
+  for (size_t i = 0; i < cached.size(); i++) {
+    if (cached[i]) rows.push_back(i);
+  }
+  std::stable_sort(rows.begin(), rows.end(), [&](const size_t a, const size_t b) -> bool {
+    return static_cast<double>(row_costs[a]) / get_row_bytes(cached_connections[a].capacity()) <
+           static_cast<double>(row_costs[b]) / get_row_bytes(cached_connections[b].capacity());
+  });
+  for (const size_t i : rows) {
+    if (cache_used <= cache_budget) break;
+    cache_used -= get_row_bytes(cached_connections[i].capacity());
+    std::vector<std::pair<size_t, double>>().swap(cached_connections[i]);
+    cached[i] = 0;
+  }
+}
+
+template <class S, size_t N>
+void HelperStrings<S, N>::end_pass() {
+  size_t n_rows = n_hits + n_extensions + n_misses;
+  size_t n_hits_total = n_hits;
+  size_t n_extensions_total = n_extensions;
+  size_t cache_used_total = cache_used;
+  Parallel::reduce_to_sum(n_rows);
+  Parallel::reduce_to_sum(n_hits_total);
+  Parallel::reduce_to_sum(n_extensions_total);
+  Parallel::reduce_to_sum(cache_used_total);
+  if (Parallel::is_master() && n_rows > 0) {
+    printf(
+        "Connection cache: %.1f%% hits, %.1f%% extended, %.3g MB\n",
+        100.0 * n_hits_total / n_rows,
+        100.0 * n_extensions_total / n_rows,
+        cache_used_total * 1e-6);
+  }
+  n_hits = n_extensions = n_misses = 0;
+  if (cache_planned) return;
+
+  // Keep the rows that save the most work per byte within the budget.
+  cache_planned = true;
+  const size_t n_dets = dets.size();
+  std::vector<size_t> rows;
+  for (size_t i = Parallel::get_id(); i < n_dets; i += Parallel::get_n()) rows.push_back(i);
+  std::stable_sort(rows.begin(), rows.end(), [&](const size_t a, const size_t b) -> bool {
+    return static_cast<double>(row_costs[a]) / get_row_bytes(row_sizes[a]) >
+           static_cast<double>(row_costs[b]) / get_row_bytes(row_sizes[b]);
+  });
+  cacheable.assign(n_dets, 0);
+  cache_used = 0;
+  for (const size_t i : rows) {
+    const size_t bytes = get_row_bytes(row_sizes[i]);
+    if (cache_used + bytes > cache_budget) continue;
+    cacheable[i] = 1;
+    cache_used += bytes;
+  }
+  for (const size_t i : rows) {
+    if (cached[i] && !cacheable[i]) {
+      std::vector<std::pair<size_t, double>>().swap(cached_connections[i]);
+      cached[i] = 0;
+    }
+  }
+}
+
+template <class S, size_t N>
+bool HelperStrings<S, N>::reserve_cache(const size_t bytes) {
+  size_t used;
+#pragma omp atomic capture
+  used = cache_used += bytes;
+  if (used <= cache_budget) return true;
+#pragma omp atomic
+  cache_used -= bytes;
+  return false;
+}
+
+template <class S, size_t N>
+void HelperStrings<S, N>::setup_strings(const size_t start) {
+  if (start == 0 && dets.size() > 0) {
+    n_up_elecs = dets[0].up.get_n_elecs();
+    n_dn_elecs = dets[0].dn.get_n_elecs();
+  }
+  std::vector<std::pair<uint32_t, uint32_t>> up_entries, dn_entries, up_m1_entries, dn_m1_entries;
+  std::vector<std::pair<uint32_t, uint32_t>> up_m1_string_entries, dn_m1_string_entries;
+  for (size_t i = start; i < dets.size(); i++) {
+    const uint32_t up_id =
+        get_string_id(dets[i].up, up_ids, up_m1_ids, up_m1_ids_of, up_m1_string_entries);
+    const uint32_t dn_id =
+        get_string_id(dets[i].dn, dn_ids, dn_m1_ids, dn_m1_ids_of, dn_m1_string_entries);
+    det_up_ids.push_back(up_id);
+    det_dn_ids.push_back(dn_id);
+    up_entries.push_back(std::make_pair(up_id, i));
+    dn_entries.push_back(std::make_pair(dn_id, i));
+    for (size_t k = 0; k < n_up_elecs; k++) {
+      up_m1_entries.push_back(std::make_pair(up_m1_ids_of[up_id * n_up_elecs + k], i));
+    }
+    for (size_t k = 0; k < n_dn_elecs; k++) {
+      dn_m1_entries.push_back(std::make_pair(dn_m1_ids_of[dn_id * n_dn_elecs + k], i));
+    }
+  }
+  dets_by_up.merge(up_entries, up_ids.size());
+  dets_by_dn.merge(dn_entries, dn_ids.size());
+  dets_by_up_m1.merge(up_m1_entries, up_m1_ids.size());
+  dets_by_dn_m1.merge(dn_m1_entries, dn_m1_ids.size());
+  if (!sorted_connections) return;
+
+  ups_by_up_m1.merge(up_m1_string_entries, up_m1_ids.size());
+  dns_by_dn_m1.merge(dn_m1_string_entries, dn_m1_ids.size());
+  for (size_t up_id = 0; up_id < up_ids.size(); up_id++) {
+    std::sort(
+        dets_by_up.items.begin() + dets_by_up.offsets[up_id],
+        dets_by_up.items.begin() + dets_by_up.offsets[up_id + 1],
+        [&](const size_t a, const size_t b) -> bool { return det_dn_ids[a] < det_dn_ids[b]; });
+  }
+}
+
+template <class S, size_t N>
+uint32_t HelperStrings<S, N>::get_string_id(
+    const SpinDet<N>& spin_det,
+    std::unordered_map<SpinDet<N>, uint32_t, boost::hash<SpinDet<N>>>& ids,
+    std::unordered_map<SpinDet<N>, uint32_t, boost::hash<SpinDet<N>>>& m1_ids,
+    std::vector<uint32_t>& m1_ids_of,
+    std::vector<std::pair<uint32_t, uint32_t>>& m1_entries) {
+  const auto& inserted = ids.insert(std::make_pair(spin_det, ids.size()));
+  const uint32_t string_id = inserted.first->second;
+  if (!inserted.second) return string_id;
+  SpinDet<N> spin_det_m1(spin_det);
+  for (const auto orb : spin_det.get_elec_orbs()) {
+    spin_det_m1.set_orb(orb, false);
+    const auto& inserted_m1 = m1_ids.insert(std::make_pair(spin_det_m1, m1_ids.size()));
+    m1_ids_of.push_back(inserted_m1.first->second);
+    m1_entries.push_back(std::make_pair(inserted_m1.first->second, string_id));
+    spin_det_m1.set_orb(orb, true);
+  }
+  return string_id;
+}
+
+template <class S, size_t N>
+void HelperStrings<S, N>::get_singles(
+    const uint32_t string_id,
+    const size_t n_elecs,
+    const std::vector<uint32_t>& m1_ids_of,
+    const StringIndex& strings_by_m1,
+    std::vector<uint32_t>& singles) {
+  // A single excitation shares exactly one m1 string, so there are no duplicates.
+  singles.clear();
+  for (size_t k = 0; k < n_elecs; k++) {
+    for (const size_t other_id : strings_by_m1.get(m1_ids_of[string_id * n_elecs + k])) {
+      if (other_id != string_id) singles.push_back(other_id);
+    }
+  }
+  std::sort(singles.begin(), singles.end());
+}
+
+template <class S, size_t N>
+void HelperStrings<S, N>::StringIndex::merge(
+    const std::vector<std::pair<uint32_t, uint32_t>>& entries, const size_t n_strings) {
+  // Numbers of new items per string, then the cursors where they go.
+  std::vector<size_t> cursors(n_strings, 0);
+  for (const auto& entry : entries) cursors[entry.first]++;
+  const size_t n_items_old = items.size();
+  offsets.resize(n_strings + 1, n_items_old);
+  items.resize(n_items_old + entries.size());
+
+  // Move the existing blocks back from the last string on, so that each block moves before the
+  // blocks ahead of it overwrite its items.
+  size_t old_end = n_items_old;
+  size_t new_end = items.size();
+  for (size_t id = n_strings; id-- > 0;) {
+    const size_t old_begin = offsets[id];
+    const size_t new_begin = new_end - (old_end - old_begin) - cursors[id];
+    std::move_backward(
+        items.begin() + old_begin,
+        items.begin() + old_end,
+        items.begin() + new_begin + (old_end - old_begin));
+    cursors[id] = new_begin + (old_end - old_begin);
+    offsets[id + 1] = new_end;
+    old_end = old_begin;
+    new_end = new_begin;
+  }
+
+  // Existing items first, then the new ones in the order given.
+  for (const auto& entry : entries) items[cursors[entry.first]++] = entry.second;
+}
+
+template <class S, size_t N>
+const std::vector<std::pair<size_t, double>>& HelperStrings<S, N>::find_connections(
+    const std::size_t i) {
+  const size_t n_dets = dets.size();
+  const int thread_id = omp_get_thread_num();
+  auto& connections = thread_connections[thread_id];
+  connections.clear();
+  auto& row = cached_connections[i];
+
+  if (cached[i] && cached_n_dets[i] == n_dets) {
+#pragma omp atomic
+    n_hits++;
+    return row;
+  }
+
+  if (cached[i]) {
+    // Only the connections to the dets appended since the row was completed are missing.
+#pragma omp atomic
+    n_extensions++;
+    const size_t cost = add_connections(i, cached_n_dets[i], connections);
+    row_costs[i] = std::min<size_t>(row_costs[i] + cost, UINT32_MAX);
+    row_sizes[i] = row.size() + connections.size();
+    cached_n_dets[i] = n_dets;
+    if (reserve_cache(connections.size() * sizeof(std::pair<size_t, double>))) {
+      // Grow to the exact size rather than geometrically, which would exceed the bytes reserved.
+      std::vector<std::pair<size_t, double>> extended_row;
+      extended_row.reserve(row.size() + connections.size());
+      extended_row.insert(extended_row.end(), row.begin(), row.end());
+      extended_row.insert(extended_row.end(), connections.begin(), connections.end());
+      row.swap(extended_row);
+      return row;
+    }
+
+    // Out of budget, drop the row from the cache.
+    const size_t bytes = get_row_bytes(row.capacity());
+    connections.insert(connections.end(), row.begin(), row.end());
+    std::vector<std::pair<size_t, double>>().swap(row);
+    cached[i] = 0;
+    cacheable[i] = 0;
+#pragma omp atomic
+    cache_used -= bytes;
+    return connections;
+  }
+
+#pragma omp atomic
+  n_misses++;
+  const size_t cost = add_connections(i, i, connections);
+  if (!cache_planned) {
+    row_costs[i] = std::min<size_t>(cost, UINT32_MAX);
+    row_sizes[i] = connections.size();
+  }
+  if (!cacheable[i]) return connections;
+
+  // Planned rows have their bytes reserved already. Before that, cache while the budget lasts.
+  if (!cache_planned && !reserve_cache(get_row_bytes(connections.size()))) return connections;
+  row = connections;
+  cached[i] = 1;
+  cached_n_dets[i] = n_dets;
+  return row;
+}
+
+template <class S, size_t N>
+const std::vector<std::pair<size_t, double>>& HelperStrings<S, N>::find_connections_from(
+    const std::size_t i, const std::size_t start) {
+  auto& connections = thread_connections[omp_get_thread_num()];
+  connections.clear();
+  add_connections(i, std::max(i, start), connections);
+  return connections;
+}
+
+template <class S, size_t N>
+size_t HelperStrings<S, N>::add_connections(
+    const size_t i, const size_t start, std::vector<std::pair<size_t, double>>& connections) {
+  const int thread_id = omp_get_thread_num();
+  const size_t n_connections_old = connections.size();
+  size_t cost = 0;
+  const Det<N>& det = dets[i];
+  const uint32_t up_id = det_up_ids[i];
+  const uint32_t dn_id = det_dn_ids[i];
+
+  // Two up/dn excitations. Strings beyond a double excitation are skipped before evaluating H.
+  // Det i itself is in its dn block and takes its stored diagonal. The lists are in ascending
+  // det order, except for the alpha blocks in sorted mode, so the scans start at start.
+  for (const std::size_t det_id : dets_by_dn.get(dn_id, start)) {
+    cost++;
+    if (!connected[thread_id][det_id]) {
+      if (det.up.get_n_diffs(dets[det_id].up) > 4) continue;
+      connected[thread_id][det_id] = true;
+      const double H = det_id == i ? diagonals[i] : solver.hamiltonian(det, dets[det_id]);
+      connections.push_back(std::make_pair(det_id, H));
+    }
+  }
+  const Span<uint32_t> up_block =
+      sorted_connections ? dets_by_up.get(up_id) : dets_by_up.get(up_id, start);
+  for (const std::size_t det_id : up_block) {
+    cost++;
+    if (!connected[thread_id][det_id]) {
+      if (det_id < start || det.dn.get_n_diffs(dets[det_id].dn) > 4) continue;
+      connected[thread_id][det_id] = true;
+      const double H = solver.hamiltonian(det, dets[det_id]);
+      connections.push_back(std::make_pair(det_id, H));
+    }
+  }
+
+  // One up one dn excitation. Symmetries conserved by the solver, such as the total momentum
+  // of HEG dets, hold for every candidate here, since the dets all share those of the reference.
+  if (sorted_connections) {
+    cost += add_opposite_spin_connections(i, start, connections);
+  } else {
+    std::vector<std::size_t> one_ups;
+    for (std::size_t k = 0; k < n_up_elecs; k++) {
+      for (const std::size_t det_id :
+           dets_by_up_m1.get(up_m1_ids_of[up_id * n_up_elecs + k], start)) {
+        cost++;
+        one_up[thread_id][det_id] = true;
+        one_ups.push_back(det_id);
+      }
+    }
+    for (std::size_t k = 0; k < n_dn_elecs; k++) {
+      for (const std::size_t det_id :
+           dets_by_dn_m1.get(dn_m1_ids_of[dn_id * n_dn_elecs + k], start)) {
+        cost++;
+        if (one_up[thread_id][det_id] && !connected[thread_id][det_id]) {
+          connected[thread_id][det_id] = true;
+          const double H = solver.hamiltonian(det, dets[det_id]);
+          connections.push_back(std::make_pair(det_id, H));
+        }
+      }
+    }
+    for (const std::size_t det_id : one_ups) one_up[thread_id][det_id] = false;
+  }
+
+  // Reset connected and return.
+  for (size_t k = n_connections_old; k < connections.size(); k++) {
+    connected[thread_id][connections[k].first] = false;
+  }
+
+  return cost + connections.size() - n_connections_old;
+}
+
+template <class S, size_t N>
+size_t HelperStrings<S, N>::add_opposite_spin_connections(
+    const size_t i, const size_t start, std::vector<std::pair<size_t, double>>& connections) {
+  const int thread_id = omp_get_thread_num();
+  size_t cost = 0;
+  const Det<N>& det = dets[i];
+  auto& ups = up_singles[thread_id];
+  auto& dns = dn_singles[thread_id];
+  get_singles(det_up_ids[i], n_up_elecs, up_m1_ids_of, ups_by_up_m1, ups);
+  get_singles(det_dn_ids[i], n_dn_elecs, dn_m1_ids_of, dns_by_dn_m1, dns);
+  if (dns.empty()) return 0;
+
+  // Dets in the block of an up single are sorted by dn id, so their intersection with the dn
+  // singles is a linear merge.
+  for (const uint32_t up_id : ups) {
+    const auto& block = dets_by_up.get(up_id);
+    auto it_det = block.begin();
+    auto it_dn = dns.begin();
+    while (it_det != block.end() && it_dn != dns.end()) {
+      cost++;
+      const uint32_t dn_id = det_dn_ids[*it_det];
+      if (dn_id < *it_dn) {
+        it_det++;
+      } else if (dn_id > *it_dn) {
+        it_dn++;
+      } else {
+        const size_t det_id = *it_det;
+        if (det_id >= start) {
+          connections.push_back(std::make_pair(det_id, solver.hamiltonian(det, dets[det_id])));
+        }
+        it_det++;
+        it_dn++;
+      }
+    }
+  }
+
+  return cost;
+}
+
+#endif
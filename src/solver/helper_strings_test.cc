@@ -0,0 +1,186 @@
+#include "helper_strings.h"
+#include "../heg_solver/heg_solver.h"
+#include "gtest/gtest.h"
+
+typedef std::vector<std::pair<size_t, double>> Connections;
+
+class HelperStringsTest : public ::testing::Test {
+ protected:
+  static constexpr size_t N_ELECS = 3;
+
+  HEGSolver<1> solver;
+
+  Wavefunction<1> wf;
+
+  // The HF det and two generations of its connected dets.
+  void SetUp() override {
+    solver.setup_lazy(N_ELECS, N_ELECS, 1.0, 1.5, 1.0e-3);
+    Det<1> det_hf;
+    for (Orbital i = 0; i < N_ELECS; i++) {
+      det_hf.up.set_orb(i, true);
+      det_hf.dn.set_orb(i, true);
+    }
+    std::unordered_set<Det<1>, boost::hash<Det<1>>> dets_set;
+    dets_set.insert(det_hf);
+    wf.append_term(det_hf, 1.0, solver.hamiltonian(det_hf, det_hf));
+    size_t start = 0;
+    for (int generation = 0; generation < 2; generation++) {
+      const size_t end = wf.size();
+      for (size_t i = start; i < end; i++) {
+        for (const auto& connected : solver.find_connected_dets(wf.get_det(i), 1.0e-3)) {
+          const auto& det = connected.first;
+          if (!dets_set.insert(det).second) continue;
+          wf.append_term(det, 0.0, solver.hamiltonian(det, det));
+        }
+      }
+      start = end;
+    }
+  }
+
+  // Rows of all the dets, each sorted by j.
+  static std::vector<Connections> find_all_connections(
+      HelperStrings<HEGSolver<1>, 1>& helper_strings, const size_t n_dets) {
+    std::vector<Connections> rows(n_dets);
+    for (size_t i = 0; i < n_dets; i++) {
+      rows[i] = helper_strings.find_connections(i);
+      std::sort(rows[i].begin(), rows[i].end());
+    }
+    helper_strings.end_pass();
+    return rows;
+  }
+};
+
+TEST_F(HelperStringsTest, IncrementalUpdateMatchesFreshBuild) {
+  const size_t n_dets = wf.size();
+  const size_t n_dets_prefix = n_dets / 3;
+  ASSERT_GT(n_dets_prefix, 1u);
+  const auto& dets = wf.get_dets();
+  const auto& diagonals = wf.get_diagonals();
+
+  HelperStrings<HEGSolver<1>, 1> fresh(solver, false, 1000.0);
+  fresh.update(dets, diagonals);
+  const auto& expected = find_all_connections(fresh, n_dets);
+
+  // Cache the rows of the prefix, then extend them with the connections to the new dets.
+  HelperStrings<HEGSolver<1>, 1> incremental(solver, false, 1000.0);
+  incremental.update(
+      Span<Det<1>>(dets.data(), n_dets_prefix), Span<double>(diagonals.data(), n_dets_prefix));
+  find_all_connections(incremental, n_dets_prefix);
+  incremental.update(dets, diagonals);
+  for (int pass = 0; pass < 2; pass++) {
+    const auto& rows = find_all_connections(incremental, n_dets);
+    for (size_t i = 0; i < n_dets; i++) {
+      EXPECT_EQ(rows[i], expected[i]);
+      ASSERT_FALSE(rows[i].empty());
+      EXPECT_EQ(rows[i].front(), std::make_pair(i, diagonals[i]));
+    }
+  }
+}
+
+TEST_F(HelperStringsTest, ExtensionScansOnlyNewDets) {
+  const size_t n_dets = wf.size();
+  const size_t n_dets_prefix = n_dets / 3;
+  const auto& dets = wf.get_dets();
+  const auto& diagonals = wf.get_diagonals();
+
+  // Candidates of det i in the string lists of the dets j >= start, plus its connections there.
+  const auto& get_expected_cost = [&](const size_t i, const size_t start, const size_t end) {
+    const auto& get_n_m1_shared = [](const SpinDet<1>& a, const SpinDet<1>& b) -> size_t {
+      const size_t n_diffs = a.get_n_diffs(b);
+      return n_diffs == 0 ? a.get_n_elecs() : n_diffs == 2 ? 1 : 0;
+    };
+    size_t cost = 0;
+    for (size_t j = start; j < end; j++) {
+      const size_t n_diffs_up = dets[i].up.get_n_diffs(dets[j].up);
+      const size_t n_diffs_dn = dets[i].dn.get_n_diffs(dets[j].dn);
+      cost += (n_diffs_up == 0) + (n_diffs_dn == 0) + (n_diffs_up + n_diffs_dn <= 4);
+      cost += get_n_m1_shared(dets[i].up, dets[j].up) + get_n_m1_shared(dets[i].dn, dets[j].dn);
+    }
+    return cost;
+  };
+
+  HelperStrings<HEGSolver<1>, 1> helper_strings(solver, false, 1000.0);
+  helper_strings.update(
+      Span<Det<1>>(dets.data(), n_dets_prefix), Span<double>(diagonals.data(), n_dets_prefix));
+  find_all_connections(helper_strings, n_dets_prefix);
+  for (size_t i = 0; i < n_dets_prefix; i++) {
+    EXPECT_EQ(helper_strings.get_row_cost(i), get_expected_cost(i, i, n_dets_prefix));
+  }
+
+  // The cached rows add the cost of the new dets only.
+  helper_strings.update(dets, diagonals);
+  find_all_connections(helper_strings, n_dets);
+  for (size_t i = 0; i < n_dets; i++) {
+    const size_t expected_cost = i < n_dets_prefix ? get_expected_cost(i, i, n_dets_prefix) +
+                                                         get_expected_cost(i, n_dets_prefix, n_dets)
+                                                   : get_expected_cost(i, i, n_dets);
+    EXPECT_EQ(helper_strings.get_row_cost(i), expected_cost);
+  }
+}
+
+TEST_F(HelperStringsTest, BoundedCacheMatchesUncached) {
+  const size_t n_dets = wf.size();
+  const size_t n_dets_prefix = n_dets / 3;
+  const auto& dets = wf.get_dets();
+  const auto& diagonals = wf.get_diagonals();
+
+  HelperStrings<HEGSolver<1>, 1> uncached(solver, false, 0.0);
+  uncached.update(dets, diagonals);
+  const auto& expected = find_all_connections(uncached, n_dets);
+  EXPECT_EQ(uncached.get_cache_used(), 0u);
+
+  // The prefix fits in a third of the full rows, so rows are dropped when extending and planning.
+  size_t n_bytes_total = 0;
+  for (const auto& row : expected) {
+    n_bytes_total += sizeof(Connections) + row.size() * sizeof(std::pair<size_t, double>);
+  }
+  const double cache_mb = n_bytes_total / 3 * 1.0e-6;
+  HelperStrings<HEGSolver<1>, 1> bounded(solver, false, cache_mb);
+  bounded.update(
+      Span<Det<1>>(dets.data(), n_dets_prefix), Span<double>(diagonals.data(), n_dets_prefix));
+  for (int pass = 0; pass < 2; pass++) {
+    const auto& rows = find_all_connections(bounded, n_dets_prefix);
+    EXPECT_LE(bounded.get_cache_used(), cache_mb * 1e6);
+    for (size_t i = 0; i < n_dets_prefix; i++) {
+      Connections expected_row;
+      for (const auto& connection : expected[i]) {
+        if (connection.first < n_dets_prefix) expected_row.push_back(connection);
+      }
+      EXPECT_EQ(rows[i], expected_row);
+    }
+  }
+  bounded.update(dets, diagonals);
+  for (int pass = 0; pass < 3; pass++) {
+    const auto& rows = find_all_connections(bounded, n_dets);
+    EXPECT_GT(bounded.get_cache_used(), 0u);
+    EXPECT_LE(bounded.get_cache_used(), cache_mb * 1e6);
+    for (size_t i = 0; i < n_dets; i++) EXPECT_EQ(rows[i], expected[i]);
+  }
+}
+
+TEST_F(HelperStringsTest, SortedConnectionsMatchDefault) {
+  const size_t n_dets = wf.size();
+  const size_t n_dets_prefix = n_dets / 3;
+  const auto& dets = wf.get_dets();
+  const auto& diagonals = wf.get_diagonals();
+
+  HelperStrings<HEGSolver<1>, 1> unsorted(solver, false, 0.0);
+  unsorted.update(dets, diagonals);
+  const auto& expected = find_all_connections(unsorted, n_dets);
+
+  // Also after an update, which merges new dets into the beta-sorted alpha blocks.
+  HelperStrings<HEGSolver<1>, 1> sorted(solver, true, 0.0);
+  sorted.update(
+      Span<Det<1>>(dets.data(), n_dets_prefix), Span<double>(diagonals.data(), n_dets_prefix));
+  sorted.update(dets, diagonals);
+  const auto& rows = find_all_connections(sorted, n_dets);
+  size_t n_opposite_spin = 0;
+  for (size_t i = 0; i < n_dets; i++) {
+    EXPECT_EQ(rows[i], expected[i]);
+    for (const auto& connection : rows[i]) {
+      const auto& det = dets[connection.first];
+      if (!(det.up == dets[i].up) && !(det.dn == dets[i].dn)) n_opposite_spin++;
+    }
+  }
+  EXPECT_GT(n_opposite_spin, 0u);
+}
@@ -2,11 +2,35 @@
 #define SOLVER_H_
 
 #include <boost/functional/hash.hpp>
+#include <boost/format.hpp>
+#include "../config.h"
+#include "../parallel.h"
 #include "../std.h"
+#include "../time.h"
 #include "../wavefunction/wavefunction.h"
+#include "davidson.h"
 #include "helper_strings.h"
+#include "sparse_matrix.h"
 
+// S is the concrete solver (CRTP). It provides hamiltonian and find_connected_dets, which are
+// dispatched statically so that the hot loops can inline them.
+template <class S, size_t N>
 class Solver {
+ public:
+  double get_energy_var() const { return energy_var; }
+
+  size_t get_n_dets() const { return wf.size(); }
+
+  // H times vec over the dets of wf, from the stored matrix in sparse_hamiltonian mode. The
+  // helper strings, or the matrix, must have been updated with wf by the last diagonalization.
+  void multiply_hamiltonian(const std::vector<double>& vec, std::vector<double>& res) {
+    if (sparse_hamiltonian) {
+      apply_sparse_hamiltonian(vec, res);
+    } else {
+      apply_hamiltonian(vec, res, *helper_strings);
+    }
+  }
+
  protected:
   size_t n_up;
   size_t n_dn;
@@ -14,28 +38,327 @@ class Solver {
   double energy_hf;
   double energy_var;
 
-  Wavefunction wf;
-
-  virtual void solve() {}
+  // Stores the hamiltonian matrix and extends it with each new batch of dets, instead of
+  // finding the connections at every multiplication.
+  bool sparse_hamiltonian;
 
-  virtual double hamiltonian(const Det&, const Det&) const = 0;
+  Wavefunction<N> wf;
 
   void variation(const double eps);
 
-  virtual std::list<Det> find_connected_dets(const Det&, const double eps) const = 0;
-
   void save_variation_result(const std::string&);
   
   bool load_variation_result(const std::string&);
 
+  // Clears the wavefunction along with the helper strings and matrix indexed by its dets.
+  void clear_wf() {
+    wf.clear();
+    helper_strings.reset();
+    hamiltonian_matrix.clear();
+  }
+
  private:
+  // Indices of dets of wf, hashed and compared through wf itself so that the variational dets
+  // are stored once. A det not in wf is looked up through the PENDING index.
+  class DetIndexSet {
+   public:
+    explicit DetIndexSet(const Wavefunction<N>& wf)
+        : wf(wf), pending(nullptr), ids(0, Hash{this}, Equal{this}) {}
+
+    DetIndexSet(const DetIndexSet&) = delete;
+
+    bool contains(const Det<N>& det) {
+      pending = &det;
+      return ids.count(PENDING) > 0;
+    }
+
+    // i must be an index of wf.
+    void insert(const size_t i) { ids.insert(i); }
+
+    size_t size() const { return ids.size(); }
+
+   private:
+    static constexpr size_t PENDING = std::numeric_limits<size_t>::max();
+
+    const Wavefunction<N>& wf;
+
+    const Det<N>* pending;
+
+    const Det<N>& get_det(const size_t i) const { return i == PENDING ? *pending : wf.get_det(i); }
+
+    struct Hash {
+      const DetIndexSet* set;
+      size_t operator()(const size_t i) const { return set->get_det(i).get_hash(); }
+    };
+
+    struct Equal {
+      const DetIndexSet* set;
+      bool operator()(const size_t a, const size_t b) const {
+        return set->get_det(a) == set->get_det(b);
+      }
+    };
+
+    std::unordered_set<size_t, Hash, Equal> ids;
+  };
+
   bool converged;
 
-  Det generate_hf_det();
+  // Kept while the dets are only appended, i.e. until the wavefunction is cleared.
+  std::unique_ptr<HelperStrings<S, N>> helper_strings;
+
+  // Upper triangle of the local rows in sparse_hamiltonian mode, extended with each new batch.
+  SparseMatrix hamiltonian_matrix;
+
+  const S& derived() const { return static_cast<const S&>(*this); }
+
+  Det<N> generate_hf_det();
 
   double diagonalize(const bool has_new_dets);
 
-  std::vector<double> apply_hamiltonian(const std::vector<double>&, HelperStrings&);
+  void apply_hamiltonian(const std::vector<double>&, std::vector<double>&, HelperStrings<S, N>&);
+
+  // Adds the rows of the new dets and the columns of the new dets in the old rows.
+  void extend_hamiltonian_matrix();
+
+  void apply_sparse_hamiltonian(const std::vector<double>&, std::vector<double>&);
 };
 
-#endif
\ No newline at end of file
+template <class S, size_t N>
+constexpr size_t Solver<S, N>::DetIndexSet::PENDING;
+
+template <class S, size_t N>
+Det<N> Solver<S, N>::generate_hf_det() {
+  Det<N> det;
+  for (size_t i = 0; i < n_up; i++) det.up.set_orb(i, true);
+  for (size_t i = 0; i < n_dn; i++) det.dn.set_orb(i, true);
+  return det;
+}
+
+template <class S, size_t N>
+void Solver<S, N>::variation(const double eps_var) {
+  const double THRESHOLD = 1.0e-6;
+
+  // Setup HF or existing wf as initial wf and evaluate energy.
+  if (wf.size() == 0) {
+    const Det<N>& det_hf = generate_hf_det();
+    energy_hf = energy_var = derived().hamiltonian(det_hf, det_hf);
+    wf.append_term(det_hf, 1.0, energy_hf);
+    if (Parallel::is_master()) printf("HF energy: %#.15g Ha\n", energy_hf);
+  }
+
+  DetIndexSet var_dets_set(wf);
+  for (size_t i = 0; i < wf.size(); i++) var_dets_set.insert(i);
+  double energy_var_new = 0.0;  // Ensures the first iteration will run.
+  size_t n_iter = 0;
+  converged = false;
+  while (!converged) {
+    Time::start("Variation: " + std::to_string(n_iter));
+
+    // New dets are appended directly and only scanned from the next iteration on.
+    // Their diagonal elements are derived from the parent's in O(n_elecs).
+    // Dets are scanned in descending |coef| so that the rest can be skipped once eps exceeds
+    // the largest matrix element.
+    const size_t n_dets_old = wf.size();
+    for (const size_t i : wf.get_order_by_coefs()) {
+      if (eps_var > max_abs_H * fabs(wf.get_coef(i))) break;
+      const double eps = eps_var / fabs(wf.get_coef(i));
+      const auto& connected_dets = derived().find_connected_dets(wf.get_det(i), eps);
+      for (const auto& connected_det : connected_dets) {
+        const auto& new_det = connected_det.first;
+        if (var_dets_set.contains(new_det)) continue;
+        const double diagonal =
+            derived().get_excited_diagonal(wf.get_det(i), wf.get_diagonal(i), connected_det.second);
+        wf.append_term(new_det, 0.0, diagonal);
+        var_dets_set.insert(wf.size() - 1);
+      }
+    }
+    const size_t n_new_dets = wf.size() - n_dets_old;
+
+    if (Parallel::is_master()) {
+      printf("New / total dets: %'zu / %'zu\n", n_new_dets, var_dets_set.size());
+    }
+    Time::checkpoint("found new dets");
+
+    energy_var_new = diagonalize(n_new_dets > 0);
+    if (fabs(energy_var - energy_var_new) < THRESHOLD) converged = true;
+    energy_var = energy_var_new;
+    if (Parallel::is_master()) {
+      printf("Variation energy: %#.15g Ha\n", energy_var);
+      printf("Correlation energy (variation): %#.15g Ha\n", energy_var - energy_hf);
+    }
+
+    Time::end();
+    n_iter++;
+  }
+
+  if (Parallel::is_master()) {
+    printf("Final variation energy: %#.15g Ha\n", energy_var);
+    printf("Correlation energy (variation): %#.15g Ha\n", energy_var - energy_hf);
+  }
+}
+
+template <class S, size_t N>
+double Solver<S, N>::diagonalize(const bool has_new_dets) {
+  const Span<double> diagonal = wf.get_diagonals();
+  const Span<double> initial_vector = wf.get_coefs();
+  const size_t max_iterations = has_new_dets ? 5 : 10;
+
+  if (!helper_strings) helper_strings.reset(new HelperStrings<S, N>(derived()));
+  helper_strings->update(wf.get_dets(), wf.get_diagonals());
+  Time::checkpoint("helper strings updated");
+  if (sparse_hamiltonian) extend_hamiltonian_matrix();
+  // Through this, so that helper_strings is not copied into the callback.
+  std::function<void(const std::vector<double>&, std::vector<double>&)> apply_hamiltonian_func =
+      std::bind(
+          &Solver<S, N>::multiply_hamiltonian, this, std::placeholders::_1, std::placeholders::_2);
+
+  Davidson davidson(diagonal, apply_hamiltonian_func, wf.size());
+  if (Parallel::is_master()) davidson.set_verbose(true);
+  const size_t n_iter = davidson.diagonalize(initial_vector, max_iterations);
+  if (!has_new_dets && n_iter < max_iterations) converged = true;
+
+  const double energy_var = davidson.get_lowest_eigenvalue();
+  const auto& coefs_new = davidson.get_lowest_eigenvector();
+
+  wf.set_coefs(coefs_new);
+
+  return energy_var;
+}
+
+#pragma omp declare reduction(      \
+    vec_double_plus : std::vector < \
+    double > : std::transform(      \
+                 omp_out            \
+                     .begin(), omp_out.end(), omp_in.begin(), omp_out.begin(), std::plus < double > ())) initializer(omp_priv = omp_orig)
+
+template <class S, size_t N>
+void Solver<S, N>::apply_hamiltonian(
+    const std::vector<double>& vec,
+    std::vector<double>& res,
+    HelperStrings<S, N>& helper_strings) {
+  const std::size_t n_dets = vec.size();
+  const size_t proc_id = Parallel::get_id();
+  const size_t n_procs = Parallel::get_n();
+  res.assign(n_dets, 0.0);
+
+#pragma omp parallel for reduction(vec_double_plus : res) schedule(dynamic, 10)
+  for (size_t i = proc_id; i < n_dets; i += n_procs) {
+    const auto& connections = helper_strings.find_connections(i);
+    for (const auto& connection : connections) {
+      const size_t j = connection.first;
+      const double H_ij = connection.second;
+      res[i] += H_ij * vec[j];
+      if (i != j) {
+        res[j] += H_ij * vec[i];
+      }
+    }
+  }
+
+  helper_strings.end_pass();
+  Parallel::reduce_to_sum_vector(res);
+  Time::checkpoint("hamiltonian applied");
+}
+
+template <class S, size_t N>
+void Solver<S, N>::extend_hamiltonian_matrix() {
+  const size_t n_dets = wf.size();
+  const size_t n_dets_old = hamiltonian_matrix.get_n_rows();
+  if (n_dets == n_dets_old) return;
+  const size_t proc_id = Parallel::get_id();
+  const size_t n_procs = Parallel::get_n();
+
+  std::vector<std::vector<std::pair<size_t, double>>> rows(n_dets);
+#pragma omp parallel for schedule(dynamic, 10)
+  for (size_t i = proc_id; i < n_dets; i += n_procs) {
+    const auto& connections = helper_strings->find_connections_from(i, n_dets_old);
+    rows[i].assign(connections.begin(), connections.end());
+  }
+  hamiltonian_matrix.append_segment(rows);
+
+  size_t n_elems = hamiltonian_matrix.get_n_elems();
+  Parallel::reduce_to_sum(n_elems);
+  if (Parallel::is_master()) printf("Hamiltonian matrix elements: %'zu\n", n_elems);
+  Time::checkpoint("hamiltonian matrix extended");
+}
+
+template <class S, size_t N>
+void Solver<S, N>::apply_sparse_hamiltonian(
+    const std::vector<double>& vec, std::vector<double>& res) {
+  const std::size_t n_dets = vec.size();
+  const size_t proc_id = Parallel::get_id();
+  const size_t n_procs = Parallel::get_n();
+  const size_t n_segments = hamiltonian_matrix.get_n_segments();
+  res.assign(n_dets, 0.0);
+
+#pragma omp parallel for reduction(vec_double_plus : res) schedule(dynamic, 10)
+  for (size_t i = proc_id; i < n_dets; i += n_procs) {
+    for (size_t segment_id = 0; segment_id < n_segments; segment_id++) {
+      for (const auto& elem : hamiltonian_matrix.get_row(segment_id, i)) {
+        const size_t j = elem.first;
+        const double H_ij = elem.second;
+        res[i] += H_ij * vec[j];
+        if (i != j) {
+          res[j] += H_ij * vec[i];
+        }
+      }
+    }
+  }
+
+  Parallel::reduce_to_sum_vector(res);
+  Time::checkpoint("hamiltonian applied");
+}
+
+
+template <class S, size_t N>
+void Solver<S, N>::save_variation_result(const std::string& filename) {
+  if (Parallel::is_master()) {
+    std::ofstream var_file;
+    var_file.open(filename);
+    var_file << boost::format("%.17g %.17g\n") % energy_hf % energy_var;
+    var_file << boost::format("%d %d %d\n") % n_up % n_dn % wf.size();
+    for (const size_t i : wf.get_order_by_coefs()) {
+      const auto& det = wf.get_det(i);
+      var_file << boost::format("%.17g\n") % wf.get_coef(i);
+      var_file << det.up << std::endl << det.dn << std::endl;
+    }
+    var_file.close();
+    printf("Variation result saved to: %s\n", filename.c_str());
+  }
+}
+
+
+template <class S, size_t N>
+bool Solver<S, N>::load_variation_result(const std::string& filename) {
+  std::ifstream var_file;
+  size_t n_dets;
+  Orbital orb_id;
+  double coef;
+  var_file.open(filename);
+  if (!var_file.is_open()) return false;  // Does not exist.
+  var_file >> energy_hf >> energy_var;
+  var_file >> n_up >> n_dn >> n_dets;
+  clear_wf();
+  for (std::size_t i = 0; i < n_dets; i++) {
+    var_file >> coef;
+    Det<N> det;
+    for (std::size_t j = 0; j < n_up; j++) {
+      var_file >> orb_id;
+      det.up.set_orb(orb_id, true);
+    }
+    for (std::size_t j = 0; j < n_dn; j++) {
+      var_file >> orb_id;
+      det.dn.set_orb(orb_id, true);
+    }
+    wf.append_term(det, coef, derived().hamiltonian(det, det));
+  }
+  var_file.close();
+  if (Parallel::is_master()) {
+    printf("Loaded %'zu dets from: %s\n", n_dets, filename.c_str());
+    printf("HF energy: %#.15g Ha\n", energy_hf);
+    printf("Variation energy: %#.15g Ha\n", energy_var);
+    printf("Correlation energy (variation): %#.15g Ha\n", energy_var - energy_hf);
+  }
+  return true;
+}
+
+#endif
@@ -0,0 +1,25 @@
+#include "solver.h"
+#include "../heg_solver/heg_solver.h"
+#include "gtest/gtest.h"
+
+TEST(SolverTest, SparseHamiltonianMatchesHelperStrings) {
+  // Each eps extends the stored matrix with the rows of the new dets and their columns in the
+  // old rows.
+  HEGSolver<1> direct, sparse;
+  direct.setup_lazy(3, 3, 1.0, 1.5, 1.0e-4, false);
+  sparse.setup_lazy(3, 3, 1.0, 1.5, 1.0e-4, true);
+  for (const double eps : {1.0e-2, 1.0e-3, 1.0e-4}) {
+    direct.variation(eps);
+    sparse.variation(eps);
+    EXPECT_NEAR(direct.get_energy_var(), sparse.get_energy_var(), 1.0e-10);
+
+    const size_t n_dets = direct.get_n_dets();
+    ASSERT_EQ(sparse.get_n_dets(), n_dets);
+    std::vector<double> vec(n_dets), res_direct, res_sparse;
+    for (size_t i = 0; i < n_dets; i++) vec[i] = sin(i + 1.0);
+    direct.multiply_hamiltonian(vec, res_direct);
+    sparse.multiply_hamiltonian(vec, res_sparse);
+    ASSERT_EQ(res_sparse.size(), n_dets);
+    for (size_t i = 0; i < n_dets; i++) EXPECT_NEAR(res_sparse[i], res_direct[i], 1.0e-10);
+  }
+}
@@ -0,0 +1,67 @@
+#ifndef HCI_SPARSE_MATRIX_H_
+#define HCI_SPARSE_MATRIX_H_
+
+#include "../span.h"
+#include "../std.h"
+
+// Sparse matrix stored as a list of CSR segments. Each segment holds the elements added at
+// once, so that rows and columns can be appended without moving the existing elements.
+class SparseMatrix {
+ public:
+  SparseMatrix() : n_rows(0), n_elems(0) {}
+
+  size_t get_n_rows() const { return n_rows; }
+
+  size_t get_n_elems() const { return n_elems; }
+
+  size_t get_n_segments() const { return segments.size(); }
+
+  // rows[i] holds the (column, value) pairs of row i added in the new segment. Rows beyond the
+  // current ones are appended. rows is cleared.
+  void append_segment(std::vector<std::vector<std::pair<size_t, double>>>& rows) {
+    segments.push_back(Segment());
+    Segment& segment = segments.back();
+    segment.offsets.resize(rows.size() + 1, 0);
+    for (size_t i = 0; i < rows.size(); i++) {
+      segment.offsets[i + 1] = segment.offsets[i] + rows[i].size();
+    }
+    segment.elems.reserve(segment.offsets.back());
+    for (auto& row : rows) {
+      segment.elems.insert(segment.elems.end(), row.begin(), row.end());
+      std::vector<std::pair<size_t, double>>().swap(row);
+    }
+    rows.clear();
+    n_rows = std::max(n_rows, segment.offsets.size() - 1);
+    n_elems += segment.elems.size();
+  }
+
+  // Elements of row i added in a segment, empty if the row did not exist yet.
+  Span<std::pair<size_t, double>> get_row(const size_t segment_id, const size_t i) const {
+    const Segment& segment = segments[segment_id];
+    if (i + 1 >= segment.offsets.size()) return Span<std::pair<size_t, double>>();
+    const size_t offset = segment.offsets[i];
+    return Span<std::pair<size_t, double>>(
+        segment.elems.data() + offset, segment.offsets[i + 1] - offset);
+  }
+
+  void clear() {
+    segments.clear();
+    n_rows = 0;
+    n_elems = 0;
+  }
+
+ private:
+  struct Segment {
+    std::vector<size_t> offsets;
+
+    std::vector<std::pair<size_t, double>> elems;
+  };
+
+  std::vector<Segment> segments;
+
+  size_t n_rows;
+
+  size_t n_elems;
+};
+
+#endif
@@ -0,0 +1,27 @@
+#include "sparse_matrix.h"
+#include "gtest/gtest.h"
+
+TEST(SparseMatrixTest, AppendSegments) {
+  SparseMatrix matrix;
+  std::vector<std::vector<std::pair<size_t, double>>> rows(2);
+  rows[0].push_back(std::make_pair(0, 1.0));
+  rows[0].push_back(std::make_pair(1, 2.0));
+  rows[1].push_back(std::make_pair(1, 3.0));
+  matrix.append_segment(rows);
+  EXPECT_TRUE(rows.empty());
+  EXPECT_EQ(matrix.get_n_rows(), 2);
+
+  // Add a new row and column.
+  rows.resize(3);
+  rows[1].push_back(std::make_pair(2, 4.0));
+  rows[2].push_back(std::make_pair(2, 5.0));
+  matrix.append_segment(rows);
+  EXPECT_EQ(matrix.get_n_rows(), 3);
+  EXPECT_EQ(matrix.get_n_elems(), 5);
+  EXPECT_EQ(matrix.get_n_segments(), 2);
+  EXPECT_EQ(matrix.get_row(0, 0).size(), 2);
+  EXPECT_EQ(matrix.get_row(0, 2).size(), 0);
+  EXPECT_EQ(matrix.get_row(1, 0).size(), 0);
+  EXPECT_EQ(matrix.get_row(1, 1)[0].first, 2);
+  EXPECT_DOUBLE_EQ(matrix.get_row(1, 2)[0].second, 5.0);
+}
@@ -0,0 +1,35 @@
+#ifndef SPAN_H_
+#define SPAN_H_
+
+#include "std.h"
+
+// Read-only view of a contiguous array owned elsewhere, e.g. the dets of a wavefunction.
+// The owner must outlive the view and must not reallocate while the view is in use.
+template <class T>
+class Span {
+ public:
+  Span() : ptr(nullptr), n(0) {}
+
+  Span(const T* ptr, const size_t n) : ptr(ptr), n(n) {}
+
+  Span(const std::vector<T>& vec) : ptr(vec.data()), n(vec.size()) {}
+
+  size_t size() const { return n; }
+
+  bool empty() const { return n == 0; }
+
+  const T& operator[](const size_t i) const { return ptr[i]; }
+
+  const T* data() const { return ptr; }
+
+  const T* begin() const { return ptr; }
+
+  const T* end() const { return ptr + n; }
+
+ private:
+  const T* ptr;
+
+  size_t n;
+};
+
+#endif
@@ -8,10 +8,12 @@
 #include <cstddef>
 #include <cstdint>
 #include <cstdio>
+#include <deque>
 #include <fstream>
 #include <functional>
 #include <iostream>
 #include <list>
+#include <memory>
 #include <sstream>
 #include <stdexcept>
 #include <string>
@@ -1,3 +0,0 @@
-#include "det.h"
-
-bool operator==(const Det& lhs, const Det& rhs) { return lhs.up == rhs.up && lhs.dn == rhs.dn; }
\ No newline at end of file
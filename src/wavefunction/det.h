@@ -4,10 +4,11 @@
 #include "../std.h"
 #include "spin_det.h"
 
+template <size_t N>
 class Det {
  public:
-  SpinDet up;
-  SpinDet dn;
+  SpinDet<N> up;
+  SpinDet<N> dn;
 
   bool get_orb(const Orbital orb_id, const Orbital dn_offset) const {
     if (orb_id < dn_offset) return up.get_orb(orb_id);
@@ -16,8 +17,8 @@ class Det {
 
   static Orbital get_n_orbs_used(
       const OrbitalsPair& pair,
-      const SpinDet::EncodeScheme scheme = SpinDet::EncodeScheme::VARIABLE) {
-    if (scheme != SpinDet::EncodeScheme::VARIABLE) {
+      const typename SpinDet<N>::EncodeScheme scheme = SpinDet<N>::EncodeScheme::VARIABLE) {
+    if (scheme != SpinDet<N>::EncodeScheme::VARIABLE) {
       throw std::invalid_argument("Only VARIABLE encode scheme implemented.");
     }
     Orbital n_orbs_used_up = pair.first.size() == 1 ? pair.first.front() : pair.first.back() + 1;
@@ -33,23 +34,34 @@ class Det {
     }
   }
 
-  void from_eor(const Det& lhs, const Det& rhs) {
+  void from_eor(const Det<N>& lhs, const Det<N>& rhs) {
     up.from_eor(lhs.up, rhs.up);
     dn.from_eor(lhs.dn, rhs.dn);
   }
 
-  OrbitalsPair encode(const SpinDet::EncodeScheme scheme = SpinDet::EncodeScheme::VARIABLE) const {
+  OrbitalsPair encode(
+      const typename SpinDet<N>::EncodeScheme scheme = SpinDet<N>::EncodeScheme::VARIABLE) const {
     return std::make_pair(up.encode(scheme), dn.encode(scheme));
   }
 
   void decode(
       const OrbitalsPair& code,
-      const SpinDet::EncodeScheme scheme = SpinDet::EncodeScheme::VARIABLE) {
+      const typename SpinDet<N>::EncodeScheme scheme = SpinDet<N>::EncodeScheme::VARIABLE) {
     up.decode(code.first, scheme);
     dn.decode(code.second, scheme);
   }
-};
 
-bool operator==(const Det&, const Det&);
+  // Zobrist fingerprint of both spins. The dn keys are the up keys rotated by 32 bits, so an
+  // excitation still updates it with one XOR per orbital.
+  uint64_t get_hash() const {
+    const uint64_t dn_hash = dn.get_hash();
+    return up.get_hash() ^ ((dn_hash << 32) | (dn_hash >> 32));
+  }
+
+  bool operator==(const Det<N>& rhs) const { return up == rhs.up && dn == rhs.dn; }
+
+  // For boost::hash.
+  friend std::size_t hash_value(const Det<N>& det) { return det.get_hash(); }
+};
 
-#endif
\ No newline at end of file
+#endif
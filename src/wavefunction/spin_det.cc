@@ -1,62 +1,30 @@
 #include "spin_det.h"
 
-void SpinDet::set_orb(const Orbital orb_id, const bool occ) {
-  if (elecs.empty()) {
-    elecs.push_back(orb_id);
-  } else if (orb_id < elecs.front()) {
-    elecs.insert(elecs.begin(), orb_id);
-  } else if (orb_id > elecs.back()) {
-    elecs.insert(elecs.end(), orb_id);
-  } else {
-    auto it = std::lower_bound(elecs.begin(), elecs.end(), orb_id);
-    if (occ) {
-      if (*it == orb_id) return;  // Already occupied.
-      elecs.insert(it, orb_id);
-    } else {
-      if (*it != orb_id) return;
-      elecs.erase(it);
-    }
-  }
-}
+template <size_t N>
+const std::array<uint64_t, N * 64> SpinDet<N>::ZOBRIST_KEYS = SpinDet<N>::generate_zobrist_keys();
 
-void SpinDet::from_eor(const SpinDet& lhs, const SpinDet& rhs) {
-  // Find the orbitals where lhs and rhs differ from each other.
-  // Store in ascending order.
-  const auto& lhs_elecs = lhs.elecs;
-  const auto& rhs_elecs = rhs.elecs;
-  const size_t lhs_size = lhs_elecs.size();
-  const size_t rhs_size = rhs_elecs.size();
-  size_t lhs_ptr = 0;
-  size_t rhs_ptr = 0;
-  elecs.clear();
-  while (lhs_ptr < lhs_size && rhs_ptr < rhs_size) {
-    if (lhs_elecs[lhs_ptr] < rhs_elecs[rhs_ptr]) {
-      elecs.push_back(lhs_elecs[lhs_ptr]);
-      lhs_ptr++;
-    } else if (lhs_elecs[lhs_ptr] > rhs_elecs[rhs_ptr]) {
-      elecs.push_back(rhs_elecs[rhs_ptr]);
-      rhs_ptr++;
-    } else {
-      lhs_ptr++;
-      rhs_ptr++;
-    }
-  }
-  while (lhs_ptr < lhs_size) {
-    elecs.push_back(lhs_elecs[lhs_ptr]);
-    lhs_ptr++;
-  }
-  while (rhs_ptr < rhs_size) {
-    elecs.push_back(rhs_elecs[rhs_ptr]);
-    rhs_ptr++;
+template <size_t N>
+std::array<uint64_t, N * 64> SpinDet<N>::generate_zobrist_keys() {
+  // SplitMix64 with a fixed seed so that all the procs share the same keys.
+  std::array<uint64_t, N * 64> keys;
+  uint64_t state = 0x2545F4914F6CDD1Dull;
+  for (auto& key : keys) {
+    state += 0x9E3779B97F4A7C15ull;
+    uint64_t z = state;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    key = z ^ (z >> 31);
   }
+  return keys;
 }
 
-const Orbitals SpinDet::encode_variable() const {
+template <size_t N>
+const Orbitals SpinDet<N>::encode_variable() const {
   Orbitals code;
   const size_t n = get_n_elecs();
   code.push_back(n);
   Orbital level = 0;
-  for (const auto orb : elecs) {
+  for (const auto orb : get_elec_orbs()) {
     while (level < n && level < orb) {
       code.push_back(level);
       level++;
@@ -67,31 +35,31 @@ const Orbitals SpinDet::encode_variable() const {
   return code;
 }
 
-void SpinDet::decode_variable(const Orbitals& code) {
+template <size_t N>
+void SpinDet<N>::decode_variable(const Orbitals& code) {
   const std::size_t n = code[0];
-  elecs.clear();
-  elecs.reserve(n);
+  words.fill(0);
+  hash = 0;
   Orbital level = 0;
   for (size_t i = 1; i < code.size(); i++) {
     const auto orb = code[i];
     while (level < n && level < orb) {
-      elecs.push_back(level);
+      set_orb(level, true);
       level++;
     }
-    if (orb >= n) elecs.push_back(orb);
+    if (orb >= n) set_orb(orb, true);
     level = orb + 1;
   }
   while (level < n) {
-    elecs.push_back(level);
+    set_orb(level, true);
     level++;
   }
 }
 
-bool operator==(const SpinDet& lhs, const SpinDet& rhs) { return lhs.elecs == rhs.elecs; }
-
-bool operator!=(const SpinDet& lhs, const SpinDet& rhs) { return lhs.elecs != rhs.elecs; }
-
-std::ostream& operator<<(std::ostream& os, const SpinDet& spin_det) {
-  for (const auto orbital : spin_det.elecs) os << orbital << " ";
-  return os;
-}
+template class SpinDet<1>;
+template class SpinDet<2>;
+template class SpinDet<4>;
+template class SpinDet<8>;
+template class SpinDet<16>;
+template class SpinDet<32>;
+template class SpinDet<64>;
@@ -4,53 +4,117 @@
 #include "../std.h"
 #include "types.h"
 
+// Occupation bitstring of one spin, stored as N 64-bit words (up to 64 * N orbitals).
+template <size_t N>
 class SpinDet {
  public:
   enum EncodeScheme { FIXED, VARIABLE };
 
-  void set_orb(const Orbital orb_id, const bool occ);
+  static constexpr size_t N_ORBS_MAX = N * 64;
 
-  bool get_orb(const Orbital orb_id) const {
-    return std::binary_search(elecs.begin(), elecs.end(), orb_id);
+  SpinDet() : hash(0) { words.fill(0); }
+
+  // Updates the Zobrist fingerprint with a single XOR when the occupation changes.
+  void set_orb(const Orbital orb_id, const bool occ) {
+    if (get_orb(orb_id) == occ) return;
+    words[orb_id >> 6] ^= 1ull << (orb_id & 63);
+    hash ^= ZOBRIST_KEYS[orb_id];
+  }
+
+  bool get_orb(const Orbital orb_id) const { return (words[orb_id >> 6] >> (orb_id & 63)) & 1; }
+
+  size_t get_n_elecs() const {
+    size_t n_elecs = 0;
+    for (size_t i = 0; i < N; i++) n_elecs += __builtin_popcountll(words[i]);
+    return n_elecs;
+  }
+
+  // Number of electrons strictly between two different orbitals, in either order.
+  size_t get_n_elecs_between(const Orbital orb_a, const Orbital orb_b) const {
+    const Orbital lo = std::min(orb_a, orb_b) + 1;
+    const Orbital hi = std::max(orb_a, orb_b);
+    const size_t lo_word = lo >> 6;
+    const size_t hi_word = hi >> 6;
+    const uint64_t lo_mask = ~0ull << (lo & 63);       // Bits at and above lo.
+    const uint64_t hi_mask = (1ull << (hi & 63)) - 1;  // Bits below hi.
+    if (lo_word == hi_word) return __builtin_popcountll(words[lo_word] & lo_mask & hi_mask);
+    size_t n_elecs = __builtin_popcountll(words[lo_word] & lo_mask);
+    for (size_t i = lo_word + 1; i < hi_word; i++) n_elecs += __builtin_popcountll(words[i]);
+    n_elecs += __builtin_popcountll(words[hi_word] & hi_mask);
+    return n_elecs;
   }
 
-  size_t get_n_elecs() const { return elecs.size(); }
+  // Number of orbitals with different occupations, i.e. twice the excitation degree.
+  size_t get_n_diffs(const SpinDet<N>& rhs) const {
+    size_t n_diffs = 0;
+    for (size_t i = 0; i < N; i++) n_diffs += __builtin_popcountll(words[i] ^ rhs.words[i]);
+    return n_diffs;
+  }
 
-  void from_eor(const SpinDet&, const SpinDet&);
+  void from_eor(const SpinDet<N>& lhs, const SpinDet<N>& rhs) {
+    for (size_t i = 0; i < N; i++) words[i] = lhs.words[i] ^ rhs.words[i];
+    hash = lhs.hash ^ rhs.hash;
+  }
 
-  const Orbitals get_elec_orbs() const { return elecs; }
+  // Zobrist fingerprint, i.e. XOR of the keys of the occupied orbitals.
+  uint64_t get_hash() const { return hash; }
+
+  // Occupied orbitals in ascending order.
+  SmallOrbitals get_elec_orbs() const {
+    SmallOrbitals elecs;
+    for (size_t i = 0; i < N; i++) {
+      uint64_t word = words[i];
+      while (word != 0) {
+        elecs.push_back((i << 6) + __builtin_ctzll(word));
+        word &= word - 1;  // Clear the lowest set bit.
+      }
+    }
+    return elecs;
+  }
 
   const Orbitals encode(const EncodeScheme scheme = VARIABLE) const {
-    if (scheme == FIXED) return elecs;
+    if (scheme == FIXED) {
+      const auto& elecs = get_elec_orbs();
+      return Orbitals(elecs.begin(), elecs.end());
+    }
     return encode_variable();
   }
 
   void decode(const Orbitals& code, const EncodeScheme scheme = VARIABLE) {
     if (scheme == FIXED) {
-      elecs = code;
+      words.fill(0);
+      hash = 0;
+      for (const auto orb : code) set_orb(orb, true);
     } else {
       decode_variable(code);
     }
   }
 
-  friend bool operator==(const SpinDet&, const SpinDet&);
+  // Full comparison only when the fingerprints collide.
+  bool operator==(const SpinDet<N>& rhs) const { return hash == rhs.hash && words == rhs.words; }
 
-  friend bool operator!=(const SpinDet&, const SpinDet&);
+  bool operator!=(const SpinDet<N>& rhs) const { return !(*this == rhs); }
 
-  friend std::ostream& operator<<(std::ostream&, const SpinDet&);
+  // For boost::hash.
+  friend std::size_t hash_value(const SpinDet<N>& spin_det) { return spin_det.hash; }
+
+  friend std::ostream& operator<<(std::ostream& os, const SpinDet<N>& spin_det) {
+    for (const auto orbital : spin_det.get_elec_orbs()) os << orbital << " ";
+    return os;
+  }
 
  private:
-  Orbitals elecs;
+  std::array<uint64_t, N> words;
 
-  const Orbitals encode_variable() const;
+  uint64_t hash;
 
-  void decode_variable(const Orbitals& code);
-};
+  static const std::array<uint64_t, N * 64> ZOBRIST_KEYS;
 
-bool operator==(const SpinDet&, const SpinDet&);
+  static std::array<uint64_t, N * 64> generate_zobrist_keys();
 
-bool operator!=(const SpinDet&, const SpinDet&);
+  const Orbitals encode_variable() const;
 
-std::ostream& operator<<(std::ostream&, const SpinDet&);
+  void decode_variable(const Orbitals& code);
+};
 
-#endif
\ No newline at end of file
+#endif
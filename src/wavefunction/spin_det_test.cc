@@ -3,7 +3,7 @@
 #include "types.h"
 
 TEST(SpinDetTest, SetAndGetOrbitals) {
-  SpinDet spin_det;
+  SpinDet<1> spin_det;
   EXPECT_FALSE(spin_det.get_orb(5));
   spin_det.set_orb(5, true);
   EXPECT_TRUE(spin_det.get_orb(5));
@@ -13,21 +13,22 @@ TEST(SpinDetTest, SetAndGetOrbitals) {
 }
 
 TEST(SpinDetTest, EncodeAndDecodeFixed) {
-  SpinDet spin_det1;
+  SpinDet<1> spin_det1;
   spin_det1.set_orb(2, true);
   spin_det1.set_orb(3, true);
-  SpinDet spin_det2;
-  spin_det2.decode(spin_det1.encode(SpinDet::EncodeScheme::FIXED), SpinDet::EncodeScheme::FIXED);
+  SpinDet<1> spin_det2;
+  spin_det2.decode(
+      spin_det1.encode(SpinDet<1>::EncodeScheme::FIXED), SpinDet<1>::EncodeScheme::FIXED);
   EXPECT_TRUE(spin_det1 == spin_det2);
 }
 
 TEST(SpinDetTest, EncodeAndDecodeVariable) {
-  SpinDet spin_det1;
+  SpinDet<1> spin_det1;
   spin_det1.set_orb(2, true);
   spin_det1.set_orb(3, true);
-  SpinDet spin_det2;
-  Orbitals code = spin_det1.encode(SpinDet::EncodeScheme::VARIABLE);
-  spin_det2.decode(code, SpinDet::EncodeScheme::VARIABLE);
+  SpinDet<1> spin_det2;
+  Orbitals code = spin_det1.encode(SpinDet<1>::EncodeScheme::VARIABLE);
+  spin_det2.decode(code, SpinDet<1>::EncodeScheme::VARIABLE);
   Orbitals expected_code({2, 0, 1, 2, 3});
   for (size_t i = 0; i < expected_code.size(); i++) {
     EXPECT_EQ(code[i], expected_code[i]);
@@ -35,8 +36,8 @@ TEST(SpinDetTest, EncodeAndDecodeVariable) {
   EXPECT_TRUE(spin_det1 == spin_det2);
 
   spin_det1.set_orb(1, true);
-  code = spin_det1.encode(SpinDet::EncodeScheme::VARIABLE);
-  spin_det2.decode(code, SpinDet::EncodeScheme::VARIABLE);
+  code = spin_det1.encode(SpinDet<1>::EncodeScheme::VARIABLE);
+  spin_det2.decode(code, SpinDet<1>::EncodeScheme::VARIABLE);
   expected_code = Orbitals({3, 0, 3});
   for (size_t i = 0; i < expected_code.size(); i++) {
     EXPECT_EQ(code[i], expected_code[i]);
@@ -44,8 +45,8 @@ TEST(SpinDetTest, EncodeAndDecodeVariable) {
   EXPECT_TRUE(spin_det1 == spin_det2);
 
   spin_det1.set_orb(0, true);
-  code = spin_det1.encode(SpinDet::EncodeScheme::VARIABLE);
-  spin_det2.decode(code, SpinDet::EncodeScheme::VARIABLE);
+  code = spin_det1.encode(SpinDet<1>::EncodeScheme::VARIABLE);
+  spin_det2.decode(code, SpinDet<1>::EncodeScheme::VARIABLE);
   expected_code = Orbitals({4});
   for (size_t i = 0; i < expected_code.size(); i++) {
     EXPECT_EQ(code[i], expected_code[i]);
@@ -54,7 +55,7 @@ TEST(SpinDetTest, EncodeAndDecodeVariable) {
 }
 
 TEST(SpinDetTest, FromEOR) {
-  SpinDet spin_det1, spin_det2, spin_det3;
+  SpinDet<1> spin_det1, spin_det2, spin_det3;
   spin_det1.set_orb(1, true);
   spin_det1.set_orb(2, true);
   spin_det2.set_orb(2, true);
@@ -63,4 +64,57 @@ TEST(SpinDetTest, FromEOR) {
   EXPECT_EQ(spin_det3.get_n_elecs(), 2);
   EXPECT_TRUE(spin_det3.get_orb(1));
   EXPECT_TRUE(spin_det3.get_orb(3));
-}
\ No newline at end of file
+}
+
+TEST(SpinDetTest, OrbitalsAcrossWords) {
+  SpinDet<4> spin_det1, spin_det2;
+  spin_det1.set_orb(3, true);
+  spin_det1.set_orb(64, true);
+  spin_det1.set_orb(130, true);
+  spin_det2.decode(spin_det1.encode());
+  EXPECT_TRUE(spin_det1 == spin_det2);
+  EXPECT_EQ(spin_det1.get_n_elecs(), 3);
+  const auto& orbs = spin_det1.get_elec_orbs();
+  EXPECT_EQ(orbs[0], 3);
+  EXPECT_EQ(orbs[1], 64);
+  EXPECT_EQ(orbs[2], 130);
+
+  spin_det2.set_orb(64, false);
+  spin_det2.set_orb(65, true);
+  EXPECT_FALSE(spin_det2.get_orb(64));
+  EXPECT_EQ(spin_det1.get_n_diffs(spin_det2), 2);
+}
+
+TEST(SpinDetTest, ZobristHash) {
+  SpinDet<2> spin_det1, spin_det2, spin_det3;
+  spin_det1.set_orb(1, true);
+  spin_det1.set_orb(70, true);
+  spin_det2.set_orb(70, true);
+  spin_det2.set_orb(1, true);
+  spin_det2.set_orb(1, true);
+  EXPECT_EQ(spin_det1.get_hash(), spin_det2.get_hash());
+
+  spin_det2.set_orb(1, false);
+  spin_det2.set_orb(2, true);
+  EXPECT_NE(spin_det1.get_hash(), spin_det2.get_hash());
+  spin_det3.from_eor(spin_det1, spin_det2);
+  SpinDet<2> spin_det4;
+  spin_det4.set_orb(1, true);
+  spin_det4.set_orb(2, true);
+  EXPECT_TRUE(spin_det3 == spin_det4);
+}
+
+TEST(SpinDetTest, ElecsBetween) {
+  SpinDet<4> spin_det;
+  spin_det.set_orb(3, true);
+  spin_det.set_orb(63, true);
+  spin_det.set_orb(64, true);
+  spin_det.set_orb(130, true);
+  spin_det.set_orb(200, true);
+  EXPECT_EQ(spin_det.get_n_elecs_between(3, 4), 0);
+  EXPECT_EQ(spin_det.get_n_elecs_between(2, 63), 1);
+  EXPECT_EQ(spin_det.get_n_elecs_between(63, 2), 1);
+  EXPECT_EQ(spin_det.get_n_elecs_between(62, 65), 2);
+  EXPECT_EQ(spin_det.get_n_elecs_between(0, 255), 5);
+  EXPECT_EQ(spin_det.get_n_elecs_between(3, 200), 3);
+}
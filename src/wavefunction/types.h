@@ -1,11 +1,14 @@
 #ifndef TYPES_H_
 #define TYPES_H_
 
+#include "../small_vector.h"
 #include "../std.h"
 
 typedef std::uint16_t Orbital;  // [0, 65535 (2^16-1)].
 typedef std::vector<Orbital> Orbitals;
+typedef SmallVector<Orbital, 64> SmallOrbitals;  // Inline for up to 64 electrons.
 typedef std::pair<Orbital, Orbital> OrbitalPair;
 typedef std::pair<Orbitals, Orbitals> OrbitalsPair;
+typedef std::array<Orbital, 4> Excitation;  // p, q -> r, s with dn orbitals offset by n_orbs.
 
 #endif
\ No newline at end of file
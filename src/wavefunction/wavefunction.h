@@ -1,48 +1,64 @@
 #ifndef HCI_WAVEFUNCTION_H_
 #define HCI_WAVEFUNCTION_H_
 
+#include "../span.h"
 #include "../std.h"
 
 #include "det.h"
-#include "term.h"
 
+// Structure of arrays: dets, coefs and diagonals are stored contiguously and share the same index.
+template <size_t N>
 class Wavefunction {
  private:
-  std::list<Term> terms;
+  std::vector<Det<N>> dets;
+
+  std::vector<double> coefs;
+
+  // Diagonal hamiltonian elements, cached so that each det only pays for them once.
+  std::vector<double> diagonals;
 
  public:
   Wavefunction() {}
 
-  size_t size() { return terms.size(); }
+  size_t size() const { return dets.size(); }
 
-  void append_term(const Det& det, const double coef) { terms.push_back(Term(det, coef)); }
+  void append_term(const Det<N>& det, const double coef, const double diagonal) {
+    dets.push_back(det);
+    coefs.push_back(coef);
+    diagonals.push_back(diagonal);
+  }
 
-  const std::list<Term>& get_terms() const { return terms; }
+  const Det<N>& get_det(const size_t i) const { return dets[i]; }
 
-  void set_coefs(const std::vector<double>& coefs) {
-    size_t i = 0;
-    for (auto& term : terms) term.coef = coefs[i++];
-  }
+  double get_coef(const size_t i) const { return coefs[i]; }
 
-  std::vector<Det> get_dets() const {
-    std::vector<Det> dets;
-    dets.reserve(terms.size());
-    for (const auto& term : terms) dets.push_back(term.det);
-    return dets;
-  }
+  double get_diagonal(const size_t i) const { return diagonals[i]; }
 
-  std::vector<double> get_coefs() const {
-    std::vector<double> coefs;
-    coefs.reserve(terms.size());
-    for (const auto& term : terms) coefs.push_back(term.coef);
-    return coefs;
-  }
+  Span<Det<N>> get_dets() const { return Span<Det<N>>(dets); }
+
+  Span<double> get_coefs() const { return Span<double>(coefs); }
+
+  Span<double> get_diagonals() const { return Span<double>(diagonals); }
 
-  void sort_by_coefs() {
-    terms.sort([](const Term& a, const Term& b) -> bool { return fabs(a.coef) > fabs(b.coef); });
+  void set_coefs(const std::vector<double>& coefs) { this->coefs = coefs; }
+
+  // Indices in descending order of the magnitude of the coefs. The dets themselves keep their
+  // insertion order so that structures indexed by them stay valid.
+  std::vector<size_t> get_order_by_coefs() const {
+    std::vector<size_t> order(dets.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](const size_t a, const size_t b) -> bool {
+      return fabs(coefs[a]) > fabs(coefs[b]);
+    });
+    return order;
   }
 
-  void clear() { terms.clear(); }
+  // Releases the storage as well.
+  void clear() {
+    std::vector<Det<N>>().swap(dets);
+    std::vector<double>().swap(coefs);
+    std::vector<double>().swap(diagonals);
+  }
 };
 
-#endif
\ No newline at end of file
+#endif